@@ -3,6 +3,9 @@
 #include <io.h>
 #include <fcntl.h>
 #include "../src/Menu.h"
+#include "../src/Trace.h"
+#include "../src/BatchRunner.h"
+#include <iostream>
 #include <thread>
 #pragma comment(lib, "ConsoleMenu.lib")
 
@@ -35,10 +38,11 @@ std::thread _threadFrame1;
 std::thread _threadFrame2;
 
 
-void DeleteTest()
+int DeleteTest(const TCHAR* open, const TCHAR* batch)
 {
 
 	MenuNode main_menu{ _T("main") };
+	main_menu.EnableIndex();
 
 	main_menu.SetMaxVisibleMenuItems(10);
 
@@ -183,12 +187,38 @@ void DeleteTest()
 	node_3->Add(std::move(item24));
 	node_3->Add(std::move(item25));
 
+	// script runs callbacks without showing menu
+	if (batch)
+	{
+		std::vector<BatchRunner::Result> results;
+		auto failed = !BatchRunner(main_menu).RunFile(batch, results);
+		if (failed)
+			std::wcout << _T("can not read ") << batch << std::endl;
+
+		for (auto&& result : results)
+		{
+			std::wcout << result.line << _T(": ") << BatchRunner::GetStatusName(result.status) << _T(" ") << result.path;
+			if (!result.message.empty())
+				std::wcout << _T(" - ") << result.message;
+			std::wcout << std::endl;
+
+			failed |= result.status != BatchRunner::bs_success;
+		}
+
+		running = false;
+		return failed ? 1 : 0;
+	}
+
+	// frames are filled only when menu is shown, batch output is not mixed with them
 	_threadFrame1 = std::thread(&Frame1AddLine, frame1, 200);
 
 	_threadFrame2 = std::thread(&Frame1AddLine, frame2, 400);
 
-	main_menu.Execute();
+	// deep link opens menu at path, unknown path opens it at the top
+	if (!open || !main_menu.ExecuteAt(open))
+		main_menu.Execute();
 	running = false;
+	return 0;
 }
 
 int _tmain(int argc, TCHAR *argv[])
@@ -196,7 +226,32 @@ int _tmain(int argc, TCHAR *argv[])
 	setlocale(LC_ALL, "");
 	_setmode(_fileno(stdout), _O_U16TEXT);
 
-	DeleteTest();
+	// --vt sends only changed cells as terminal sequences, useful over ssh
+	// --trace <file> records render, callback and lock spans for a timeline viewer
+	// --open <path> opens menu at path of captions, e.g. "main/Node 1/Item 3"
+	// --batch <file> runs callbacks of paths listed in file without showing menu, lines ending with '&' run in parallel
+	const TCHAR* trace = nullptr;
+	const TCHAR* open = nullptr;
+	const TCHAR* batch = nullptr;
+	for (auto i = 1; i < argc; ++i)
+	{
+		if (_tcscmp(argv[i], _T("--vt")) == 0)
+			Compositor::Instance().EnableEncoder(GetStdHandle(STD_OUTPUT_HANDLE), true);
+		else if (_tcscmp(argv[i], _T("--trace")) == 0 && i + 1 < argc)
+			trace = argv[++i];
+		else if (_tcscmp(argv[i], _T("--open")) == 0 && i + 1 < argc)
+			open = argv[++i];
+		else if (_tcscmp(argv[i], _T("--batch")) == 0 && i + 1 < argc)
+			batch = argv[++i];
+	}
+
+	if (trace)
+	{
+		Trace::SetThreadName("main");
+		Trace::SetEnabled(true);
+	}
+
+	auto result = DeleteTest(open, batch);
 
 	if (_threadFrame1.joinable())
 		_threadFrame1.join();
@@ -204,5 +259,11 @@ int _tmain(int argc, TCHAR *argv[])
 	if (_threadFrame2.joinable())
 		_threadFrame2.join();
 
-	return 0;
+	if (trace)
+	{
+		Trace::SetEnabled(false);
+		Trace::Export(trace);
+	}
+
+	return result;
 }
\ No newline at end of file
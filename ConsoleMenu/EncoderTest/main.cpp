@@ -0,0 +1,512 @@
+﻿// Test of OutputEncoder.
+// Random drawing is encoded, the sequences are replayed into a model of terminal
+// and the model has to show the same cells as were drawn.
+// Return code is 0 if every frame matches, seed of random drawing may be given as argument.
+
+#include <TCHAR.h>
+#include <windows.h>
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <vector>
+#include "../src/OutputEncoder.h"
+#include "../src/TextWidth.h"
+#pragma comment(lib, "ConsoleMenu.lib")
+
+using namespace Menu;
+
+namespace
+{
+	using tstring = OutputEncoder::tstring;
+
+	const WORD Defaults{ 0x07 };
+
+	struct Cell
+	{
+		// grapheme, empty for the second column of wide one
+		tstring text;
+		WORD attributes;
+
+		bool operator==(const Cell& other) const { return text == other.text && attributes == other.attributes; }
+		bool operator!=(const Cell& other) const { return !(*this == other); }
+	};
+
+	// cells of screen with rules of console: wide grapheme takes two columns, the one not fitting the row is dropped,
+	// overwritten half of wide grapheme leaves blank in the other half
+	class Screen
+	{
+	public:
+
+		Screen(SHORT width, SHORT height) :_width(width), _height(height), _cells(size_t(width) * height, Cell{ _T(" "), Defaults }) {}
+
+		SHORT GetWidth() const { return _width; }
+		SHORT GetHeight() const { return _height; }
+
+		Cell& At(SHORT x, SHORT y) { return _cells[size_t(y) * _width + x]; }
+
+		void Fill(const Cell& cell)
+		{
+			_cells.assign(_cells.size(), cell);
+		}
+
+		// place grapheme of width 1 or 2 at column
+		void Place(SHORT x, SHORT y, const tstring& text, int width, WORD attributes)
+		{
+			Split(x, y);
+			if (width == 2)
+				Split(x + 1, y);
+
+			At(x, y) = Cell{ text, attributes };
+			if (width == 2)
+				At(x + 1, y) = Cell{ tstring(), attributes };
+		}
+
+		// draw text which does not start with zero width character
+		void Put(SHORT x, SHORT y, const tstring& text, WORD attributes)
+		{
+			size_t pos = 0u;
+			while (pos < text.length() && x < _width)
+			{
+				size_t stop = pos;
+				auto width = int(Text::Measure(text, pos, text.length(), 1u, &stop));
+				if (stop == pos)
+					width = int(Text::Measure(text, pos, text.length(), 2u, &stop));
+				if (stop == pos || x + width > _width)
+					break;
+
+				Place(x, y, text.substr(pos, stop - pos), width, attributes);
+				x += SHORT(width);
+				pos = stop;
+			}
+		}
+
+	private:
+
+		SHORT _width;
+		SHORT _height;
+		std::vector<Cell> _cells;
+
+		void Split(SHORT x, SHORT y)
+		{
+			auto& cell = At(x, y);
+			if (cell.text.empty() && x > 0)
+				At(x - 1, y).text = _T(" ");
+			else if (x + 1 < _width && At(x + 1, y).text.empty())
+				At(x + 1, y).text = _T(" ");
+		}
+	};
+
+	// console bits are blue, green, red, terminal ones are red, green, blue
+	WORD Color(int ansi)
+	{
+		return WORD(((ansi & 1) << 2) | (ansi & 2) | ((ansi & 4) >> 2));
+	}
+
+	// Terminal which understands sequences the encoder may send:
+	// CUP, CUU, CUD, CUF, CUB, CNL, CPL, EL, REP, SGR and carriage return.
+	// Cursor waits for wrap after the last column as terminals do, anything else is an error.
+	class Terminal
+	{
+	public:
+
+		explicit Terminal(Screen& screen) :_screen(screen) {}
+
+		// move cursor as input echo does between frames
+		void MoveCursor(SHORT x, SHORT y)
+		{
+			_x = x;
+			_y = y;
+			_wrap = false;
+		}
+
+		// interpret output, return false and error if it is not understood
+		bool Feed(const tstring& output, tstring& error)
+		{
+			for (size_t pos = 0u; pos < output.length();)
+			{
+				auto c = output[pos];
+
+				if (c == 0x1b)
+				{
+					if (pos + 1 >= output.length() || output[pos + 1] != _T('['))
+						return Fail(error, _T("escape without ["));
+
+					std::vector<int> parameters;
+					auto value = -1;
+					pos += 2;
+					while (pos < output.length() && ((output[pos] >= _T('0') && output[pos] <= _T('9')) || output[pos] == _T(';')))
+					{
+						if (output[pos] == _T(';'))
+						{
+							parameters.emplace_back(value);
+							value = -1;
+						}
+						else
+						{
+							value = (value < 0 ? 0 : value * 10) + (output[pos] - _T('0'));
+						}
+						++pos;
+					}
+					parameters.emplace_back(value);
+
+					if (pos >= output.length())
+						return Fail(error, _T("unfinished sequence"));
+
+					if (!Execute(output[pos++], parameters, error))
+						return false;
+					continue;
+				}
+
+				if (c == _T('\r'))
+				{
+					_x = 0;
+					_wrap = false;
+					++pos;
+					continue;
+				}
+
+				if (c < _T(' '))
+					return Fail(error, _T("control character"));
+
+				// code point, surrogate pair is one
+				auto next = pos + 1;
+				uint32_t code = c;
+#ifdef UNICODE
+				if (c >= 0xD800 && c < 0xDC00 && next < output.length())
+					code = 0x10000 + ((uint32_t(c) - 0xD800) << 10) + (uint32_t(output[next++]) - 0xDC00);
+#endif
+				auto text = output.substr(pos, next - pos);
+				pos = next;
+
+				auto width = Text::CodePointWidth(code);
+				if (width == 0)
+				{
+					// mark joins the grapheme printed before
+					if (_lastX < 0)
+						return Fail(error, _T("mark without base"));
+					_screen.At(_lastX, _lastY).text += text;
+					_last += text;
+					continue;
+				}
+
+				if (!Print(text, width, error))
+					return false;
+			}
+			return true;
+		}
+
+	private:
+
+		Screen& _screen;
+
+		SHORT _x{ 0 };
+		SHORT _y{ 0 };
+		bool _wrap{ false };
+		WORD _attributes{ 0x1E };
+
+		// the last printed grapheme for repeat and its position for marks
+		tstring _last;
+		int _lastWidth{ 0 };
+		SHORT _lastX{ -1 };
+		SHORT _lastY{ -1 };
+
+		static bool Fail(tstring& error, const TCHAR* text)
+		{
+			error = text;
+			return false;
+		}
+
+		static int Count(const std::vector<int>& parameters)
+		{
+			return parameters[0] > 0 ? parameters[0] : 1;
+		}
+
+		SHORT Clamp(int value, SHORT size) const
+		{
+			return SHORT(value < 0 ? 0 : value >= size ? size - 1 : value);
+		}
+
+		bool Print(const tstring& text, int width, tstring& error)
+		{
+			if (_wrap)
+			{
+				// encoder never lets output scroll
+				if (_y + 1 >= _screen.GetHeight())
+					return Fail(error, _T("output scrolls"));
+				_x = 0;
+				++_y;
+				_wrap = false;
+			}
+
+			if (_x + width > _screen.GetWidth())
+				return Fail(error, _T("wide grapheme wraps"));
+
+			_screen.Place(_x, _y, text, width, _attributes);
+
+			_last = text;
+			_lastWidth = width;
+			_lastX = _x;
+			_lastY = _y;
+
+			_x += SHORT(width);
+			if (_x >= _screen.GetWidth())
+			{
+				_x = _screen.GetWidth() - 1;
+				_wrap = true;
+			}
+			return true;
+		}
+
+		bool Execute(TCHAR final, const std::vector<int>& parameters, tstring& error)
+		{
+			auto width = _screen.GetWidth();
+			auto height = _screen.GetHeight();
+
+			if (final != _T('b') && final != _T('m'))
+				_wrap = false;
+
+			switch (final)
+			{
+			case _T('H'):
+				_y = Clamp(Count(parameters) - 1, height);
+				_x = Clamp((parameters.size() > 1 && parameters[1] > 0 ? parameters[1] : 1) - 1, width);
+				return true;
+			case _T('A'):
+				_y = Clamp(_y - Count(parameters), height);
+				return true;
+			case _T('B'):
+				_y = Clamp(_y + Count(parameters), height);
+				return true;
+			case _T('C'):
+				_x = Clamp(_x + Count(parameters), width);
+				return true;
+			case _T('D'):
+				_x = Clamp(_x - Count(parameters), width);
+				return true;
+			case _T('E'):
+				_y = Clamp(_y + Count(parameters), height);
+				_x = 0;
+				return true;
+			case _T('F'):
+				_y = Clamp(_y - Count(parameters), height);
+				_x = 0;
+				return true;
+			case _T('K'):
+			{
+				if (parameters[0] > 0)
+					return Fail(error, _T("only erase to end of line is expected"));
+
+				// erased second half takes the whole wide grapheme
+				auto x = _x;
+				if (x > 0 && _screen.At(x, _y).text.empty())
+					--x;
+				for (; x < width; ++x)
+					_screen.At(x, _y) = Cell{ _T(" "), _attributes };
+				return true;
+			}
+			case _T('b'):
+				if (_last.empty())
+					return Fail(error, _T("repeat without character"));
+				for (auto i = Count(parameters); i > 0; --i)
+				{
+					if (!Print(_last, _lastWidth, error))
+						return false;
+				}
+				return true;
+			case _T('m'):
+				for (auto parameter : parameters)
+				{
+					if (parameter <= 0)
+						_attributes = Defaults;
+					else if (parameter == 4)
+						_attributes |= COMMON_LVB_UNDERSCORE;
+					else if (parameter >= 30 && parameter <= 37)
+						_attributes = (_attributes & ~0x0F) | Color(parameter - 30);
+					else if (parameter >= 90 && parameter <= 97)
+						_attributes = (_attributes & ~0x0F) | Color(parameter - 90) | 0x08;
+					else if (parameter >= 40 && parameter <= 47)
+						_attributes = (_attributes & ~0xF0) | (Color(parameter - 40) << 4);
+					else if (parameter >= 100 && parameter <= 107)
+						_attributes = (_attributes & ~0xF0) | ((Color(parameter - 100) | 0x08) << 4);
+					else
+						return Fail(error, _T("unknown rendition"));
+				}
+				return true;
+			default:
+				return Fail(error, _T("unknown sequence"));
+			}
+		}
+	};
+
+	// text of cell readable in any console code page
+	tstring Show(const Cell& cell)
+	{
+		std::basic_ostringstream<TCHAR> text;
+		text << _T("[");
+		for (auto c : cell.text)
+		{
+			if (c >= _T(' ') && c < 0x7f)
+				text << c;
+			else
+				text << _T("\\x") << std::hex << unsigned(c) << std::dec;
+		}
+		text << _T("] ") << std::hex << cell.attributes;
+		return text.str();
+	}
+
+	// encoder, screen drawn through it and terminal fed by it
+	class Check
+	{
+	public:
+
+		Check(SHORT width, SHORT height, bool repeat) :_target(width, height), _shown(width, height), _terminal(_shown)
+		{
+			_encoder.SetDefaultAttributes(Defaults);
+			_encoder.SetRepeatEnabled(repeat);
+			_encoder.Resize(COORD{ width, height });
+
+			// terminal content is not known to encoder
+			_shown.Fill(Cell{ _T("?"), 0x4F });
+		}
+
+		void Put(SHORT x, SHORT y, const tstring& text, WORD attributes)
+		{
+			_target.Put(x, y, text, attributes);
+			_encoder.Put(COORD{ x, y }, text, attributes);
+		}
+
+		// forget terminal content, terminal is garbled
+		void Invalidate()
+		{
+			_encoder.Invalidate();
+			_shown.Fill(Cell{ _T("?"), 0x4F });
+		}
+
+		void MoveCursor(SHORT x, SHORT y)
+		{
+			_terminal.MoveCursor(x, y);
+		}
+
+		// present and compare, describe the first difference
+		bool Present(tstring& error)
+		{
+			std::basic_ostringstream<TCHAR> stream;
+			_encoder.Present(stream);
+
+			if (!_terminal.Feed(stream.str(), error))
+				return false;
+
+			for (SHORT y = 0; y < _target.GetHeight(); ++y)
+			{
+				for (SHORT x = 0; x < _target.GetWidth(); ++x)
+				{
+					if (_target.At(x, y) != _shown.At(x, y))
+					{
+						std::basic_ostringstream<TCHAR> text;
+						text << _T("cell ") << x << _T(",") << y << _T(" is ") << Show(_shown.At(x, y)) << _T(" instead of ") << Show(_target.At(x, y));
+						error = text.str();
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+	private:
+
+		OutputEncoder _encoder;
+		Screen _target;
+		Screen _shown;
+		Terminal _terminal;
+	};
+
+	int Failed(const TCHAR* test, int frame, const tstring& error)
+	{
+		std::wcout << test << _T(" failed at frame ") << frame << _T(": ") << error << std::endl;
+		return 1;
+	}
+
+	// random changes of screen, runs of characters and blank ends of rows let encoder use repeat and erase
+	int RandomDiffs(unsigned seed, bool repeat)
+	{
+		const TCHAR* const Pieces[] = { _T("a"), _T("b"), _T("Z"), _T(" "), _T("    "), _T("aaaaaa"), _T("\x4E2D"), _T("\x6587\x6587"), _T("e\x0301") };
+		const WORD Attributes[] = { Defaults, 0x0C, 0x1F, Defaults | COMMON_LVB_UNDERSCORE, 0x70, 0x8E };
+
+		std::mt19937 random(seed);
+		auto pick = [&random](size_t count) { return size_t(random() % count); };
+
+		const SHORT width = 24;
+		const SHORT height = 8;
+		Check check(width, height, repeat);
+
+		tstring error;
+		for (auto frame = 0; frame < 2000; ++frame)
+		{
+			for (auto puts = 1 + pick(6); puts; --puts)
+			{
+				tstring text;
+				for (auto pieces = 1 + pick(8); pieces; --pieces)
+					text += Pieces[pick(sizeof(Pieces) / sizeof(Pieces[0]))];
+
+				// whole row of blanks ends with erase
+				if (pick(10) == 0)
+					text = tstring(width, _T(' '));
+
+				check.Put(SHORT(pick(width)), SHORT(pick(height)), text, Attributes[pick(sizeof(Attributes) / sizeof(Attributes[0]))]);
+			}
+
+			if (pick(50) == 0)
+				check.Invalidate();
+
+			if (!check.Present(error))
+				return Failed(repeat ? _T("random diffs") : _T("random diffs without repeat"), frame, error);
+
+			check.MoveCursor(SHORT(pick(width)), SHORT(pick(height)));
+		}
+		return 0;
+	}
+
+	// wide graphemes which do not fit, overwritten halves and the last column
+	int Edges()
+	{
+		const SHORT width = 10;
+		const SHORT height = 3;
+		Check check(width, height, true);
+		tstring error;
+
+		// the second one does not fit, the last column stays blank
+		check.Put(width - 3, 0, _T("\x4E2D\x4E2D"), Defaults);
+
+		// the last column, cursor waits for wrap
+		check.Put(width - 1, 1, _T("x"), 0x0C);
+		check.Put(0, 2, _T("\x6587\x6587\x6587\x6587\x6587"), 0x1F);
+		if (!check.Present(error))
+			return Failed(_T("edges"), 0, error);
+
+		// halves of wide graphemes are overwritten
+		check.Put(1, 2, _T("y"), Defaults);
+		check.Put(4, 2, _T("zz"), Defaults);
+		check.Put(width - 2, 1, _T("\x4E2D"), Defaults);
+		if (!check.Present(error))
+			return Failed(_T("edges"), 1, error);
+
+		// cell after the last column of the previous row
+		check.Put(width - 1, 0, _T("w"), Defaults);
+		check.Put(0, 1, _T("v"), Defaults);
+		if (!check.Present(error))
+			return Failed(_T("edges"), 2, error);
+
+		return 0;
+	}
+}
+
+int _tmain(int argc, TCHAR *argv[])
+{
+	auto seed = argc > 1 ? unsigned(_ttoi(argv[1])) : 1u;
+
+	auto failures = Edges() + RandomDiffs(seed, true) + RandomDiffs(seed + 1, false);
+	if (failures == 0)
+		std::wcout << _T("encoder test passed, seed ") << seed << std::endl;
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+﻿// Stress test: threads add, delete, batch and reload items, also in background, while keys written to console input navigate the menu.
+// Arguments: seconds to run, 10 by default, and seed of random operations.
+// Return code is nonzero if a node ends with more than one selected item or with equal hotkeys.
+//
+// Run it under a sanitizer, the library and the test have to be built with it:
+//	AddressSanitizer, toolset v142 or later:
+//		msbuild ConsoleMenu.sln /p:Configuration=Debug /p:Platform=x64 /p:PlatformToolset=v142 /p:EnableASAN=true
+//		x64\Debug\StressTest.exe 60
+//	ThreadSanitizer is not available for MSVC, portable units build with g++ against stubs of console functions
+//	whose WriteConsoleInput feeds _getwch, the stubs are not part of the repository:
+//		g++ -std=c++14 -O1 -g -fsanitize=thread -DUNICODE -D_UNICODE -I<stubs> -Isrc StressTest/main.cpp <stubs>.cpp
+//			src/Menu.cpp src/Compositor.cpp src/Style.cpp src/TextWidth.cpp src/ConsoleGeometry.cpp src/OutputEncoder.cpp
+//			src/Scrollback.cpp src/Layout.cpp src/Metrics.cpp src/MetricsFrame.cpp src/StatusFrame.cpp src/Trace.cpp
+//			src/HotkeyAllocator.cpp src/PathIndex.cpp -lpthread -o StressTest
+//		./StressTest 10
+
+#include <TCHAR.h>
+#include <windows.h>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <set>
+#include <chrono>
+#include "../src/Menu.h"
+#pragma comment(lib, "ConsoleMenu.lib")
+
+using namespace Menu;
+
+namespace
+{
+	const int NodeCount{ 4 };
+	const int MutatorCount{ 4 };
+
+	// keys are random until deadline, then menu is left
+	std::chrono::steady_clock::time_point deadline;
+
+	// main menu returned for the last time, mutators stop
+	std::atomic<bool> finished{ false };
+
+	std::atomic<uint64_t> operations{ 0u };
+	std::atomic<uint64_t> keys{ 0u };
+	std::atomic<uint64_t> callbacks{ 0u };
+
+	// key pressed and released by user, keys without character are sent as extended ones
+	void Press(WORD key, TCHAR character = 0)
+	{
+		INPUT_RECORD records[2] = {};
+		for (auto i = 0; i < 2; ++i)
+		{
+			records[i].EventType = KEY_EVENT;
+			auto& event = records[i].Event.KeyEvent;
+			event.bKeyDown = i == 0;
+			event.wRepeatCount = 1;
+			event.wVirtualKeyCode = key;
+			event.wVirtualScanCode = WORD(MapVirtualKey(key, MAPVK_VK_TO_VSC));
+			event.uChar.UnicodeChar = character;
+			event.dwControlKeyState = character ? 0 : ENHANCED_KEY;
+		}
+
+		DWORD written = 0;
+		WriteConsoleInput(GetStdHandle(STD_INPUT_HANDLE), records, 2, &written);
+		++keys;
+	}
+
+	std::shared_ptr<MenuItem> MakeItem(const tstring& caption)
+	{
+		auto item = std::make_shared<MenuItem>(caption);
+		item->Connect([]() { ++callbacks; return true; });
+		item->SetSuccessMessage(_T("done"));
+		return item;
+	}
+
+	// tree with random items, nodes and some items have the same ids in every tree, so reload matches them
+	std::shared_ptr<MenuNode> MakeTree(std::mt19937& random)
+	{
+		auto main = std::make_shared<MenuNode>(_T("main"));
+		for (auto i = 0; i < NodeCount; ++i)
+		{
+			auto node = std::make_shared<MenuNode>(_T("Node ") + std::to_wstring(i));
+			for (auto count = random() % 20; count; --count)
+				node->Add(MakeItem(_T("Item ") + std::to_wstring(random() % 30)));
+			main->Add(node);
+		}
+		return main;
+	}
+
+	std::vector<std::shared_ptr<MenuNode>> GetNodes(const MenuNode& main)
+	{
+		std::vector<std::shared_ptr<MenuNode>> nodes;
+		for (auto&& item : main.GetItems())
+		{
+			if (auto node = std::dynamic_pointer_cast<MenuNode>(item))
+				nodes.emplace_back(node);
+		}
+		return nodes;
+	}
+
+	void Mutate(std::shared_ptr<MenuNode> main, std::shared_ptr<MenuFrame> frame, unsigned seed)
+	{
+		std::mt19937 random(seed);
+		uint64_t added = 0u;
+
+		// trees built in background are reloaded before statics are destroyed
+		std::vector<std::future<void>> reloads;
+
+		while (!finished)
+		{
+			auto nodes = GetNodes(*main);
+			if (nodes.empty())
+				continue;
+
+			auto node = nodes[random() % nodes.size()];
+			auto items = node->GetItems();
+
+			switch (random() % 9)
+			{
+			case 0:
+			case 1:
+				node->Add(MakeItem(_T("Added ") + std::to_wstring(added++)));
+				break;
+			case 2:
+				if (!items.empty())
+					items[random() % items.size()]->Delete();
+				break;
+			case 3:
+				node->Batch([&]
+				{
+					for (auto i = 0; i < 3; ++i)
+						node->Add(MakeItem(_T("Batched ") + std::to_wstring(added++)));
+					if (!items.empty())
+						items[random() % items.size()]->Delete();
+				});
+				break;
+			case 4:
+			{
+				std::vector<std::shared_ptr<MenuItem>> range;
+				for (auto i = 0; i < 5; ++i)
+					range.emplace_back(MakeItem(_T("Range ") + std::to_wstring(added++)));
+				node->AddRange(std::move(range));
+				break;
+			}
+			case 5:
+				if (random() % 2)
+				{
+					main->Reload(*MakeTree(random));
+				}
+				else
+				{
+					reloads.emplace_back(main->ReloadAsync([seed = unsigned(random())]()
+					{
+						std::mt19937 random(seed);
+						return MakeTree(random);
+					}));
+				}
+				break;
+			case 6:
+				node->SetPolicy(random() % 2 ? MenuNode::HotkeyPolicy::hp_letters : MenuNode::HotkeyPolicy::hp_numbers);
+				break;
+			case 7:
+				frame->AddLine(_T("Line ") + std::to_wstring(added++));
+				break;
+			default:
+				// lists stay short enough to be walked by keys
+				if (items.size() > 200)
+					node->Reset();
+				break;
+			}
+
+			++operations;
+		}
+
+		for (auto&& reload : reloads)
+			reload.wait();
+	}
+
+	void Navigate(unsigned seed)
+	{
+		const WORD Moves[] = { VK_DOWN, VK_UP, VK_NEXT, VK_PRIOR, VK_HOME, VK_END, VK_RIGHT, VK_LEFT };
+		std::mt19937 random(seed);
+
+		while (std::chrono::steady_clock::now() < deadline)
+		{
+			switch (random() % 6)
+			{
+			case 0:
+				Press(VK_RETURN, _T('\r'));
+				break;
+			case 1:
+				Press(VK_ESCAPE, 27);
+				break;
+			case 2:
+			{
+				auto letter = TCHAR(_T('A') + random() % 26);
+				Press(WORD(letter), letter);
+				break;
+			}
+			default:
+				Press(Moves[random() % (sizeof(Moves) / sizeof(Moves[0]))]);
+				break;
+			}
+			Sleep(1);
+		}
+
+		// main menu is left
+		while (!finished)
+		{
+			Press(VK_ESCAPE, 27);
+			Sleep(10);
+		}
+	}
+
+	// node has at most one selected item and its items which are not deleted have different hotkeys
+	bool IsConsistent(const MenuNode& node)
+	{
+		auto selected = 0;
+		std::set<size_t> hotkeys;
+		auto consistent = true;
+
+		for (auto&& item : node.GetItems())
+		{
+			if (item->IsSelected())
+				++selected;
+
+			if (!item->Deleted() && item->GetHotKey() != 0 && !hotkeys.insert(item->GetHotKey()).second)
+			{
+				std::wcout << node.GetCaption() << _T(": hotkey ") << item->GetHotKey() << _T(" is taken twice") << std::endl;
+				consistent = false;
+			}
+
+			if (auto child = std::dynamic_pointer_cast<MenuNode>(item))
+				consistent &= IsConsistent(*child);
+		}
+
+		if (selected > 1)
+		{
+			std::wcout << node.GetCaption() << _T(": ") << selected << _T(" items are selected") << std::endl;
+			consistent = false;
+		}
+		return consistent;
+	}
+}
+
+int _tmain(int argc, TCHAR *argv[])
+{
+	auto seconds = argc > 1 ? _ttoi(argv[1]) : 10;
+	auto seed = argc > 2 ? unsigned(_ttoi(argv[2])) : 1u;
+
+	std::mt19937 random(seed);
+	auto main = MakeTree(random);
+	main->SetMaxVisibleMenuItems(10);
+
+	auto frame = std::make_shared<MenuFrame>(_T("Log"));
+	frame->SetTopOffset(12);
+	frame->SetLeftOffset(0);
+	frame->SetWidth(60);
+	frame->SetHeight(10);
+	main->AddFrame(frame);
+
+	deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+
+	std::vector<std::thread> threads;
+	for (auto i = 0; i < MutatorCount; ++i)
+		threads.emplace_back(&Mutate, main, frame, seed + 1 + i);
+	threads.emplace_back(&Navigate, seed);
+
+	// escape in main menu returns, it is entered again
+	do
+	{
+		main->Execute();
+	} while (std::chrono::steady_clock::now() < deadline);
+
+	finished = true;
+	for (auto&& thread : threads)
+		thread.join();
+
+	auto consistent = IsConsistent(*main);
+	std::wcout << operations << _T(" operations, ") << keys << _T(" keys, ") << callbacks << _T(" callbacks, ") << (consistent ? _T("passed") : _T("failed")) << std::endl;
+
+	return consistent ? 0 : 1;
+}
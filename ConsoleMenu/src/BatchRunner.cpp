@@ -0,0 +1,210 @@
+#include "BatchRunner.h"
+#include "Menu.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <unordered_map>
+#include <thread>
+#include <algorithm>
+
+namespace Menu {
+
+	namespace
+	{
+		const TCHAR* const Blanks = _T(" \t\r");
+
+		tstring Trim(const tstring& text)
+		{
+			auto first = text.find_first_not_of(Blanks);
+			if (first == tstring::npos)
+				return tstring();
+
+			return text.substr(first, text.find_last_not_of(Blanks) - first + 1);
+		}
+	}
+
+	BatchRunner::BatchRunner(MenuNode& root, size_t parallelism) :_root(root), _parallelism(parallelism)
+	{
+		if (_parallelism == 0u)
+			_parallelism = std::max(1u, std::thread::hardware_concurrency());
+
+		_root.EnableIndex();
+	}
+
+	std::vector<BatchRunner::Result> BatchRunner::Run(const tstring& script)
+	{
+		TraceSpan span("BatchRunner::Run", "batch");
+
+		std::vector<Result> results;
+		std::vector<Step> group;
+
+		size_t line = 0u;
+		size_t begin = 0u;
+		while (begin <= script.length())
+		{
+			auto end = script.find(_T('\n'), begin);
+			if (end == tstring::npos)
+				end = script.length();
+
+			auto text = Trim(script.substr(begin, end - begin));
+			begin = end + 1;
+			++line;
+
+			if (text.empty() || text[0] == _T('#'))
+				continue;
+
+			// group goes on while lines end with '&'
+			auto parallel = text.back() == _T('&');
+			if (parallel)
+				text = Trim(text.substr(0, text.length() - 1));
+
+			if (!text.empty())
+				group.emplace_back(Step{ text, line });
+
+			if (!parallel && !group.empty())
+			{
+				results.resize(results.size() + group.size());
+				RunGroup(group, &results[results.size() - group.size()]);
+				group.clear();
+			}
+		}
+
+		// script ended with '&'
+		if (!group.empty())
+		{
+			results.resize(results.size() + group.size());
+			RunGroup(group, &results[results.size() - group.size()]);
+		}
+
+		return results;
+	}
+
+	bool BatchRunner::RunFile(const tstring& path, std::vector<Result>& results)
+	{
+		auto file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		std::string bytes;
+		LARGE_INTEGER size;
+		auto result = GetFileSizeEx(file, &size) != 0;
+		if (result && size.QuadPart > 0)
+		{
+			bytes.resize(static_cast<size_t>(size.QuadPart));
+
+			DWORD read = 0;
+			result = ReadFile(file, &bytes[0], static_cast<DWORD>(bytes.size()), &read, nullptr) != 0 && read == bytes.size();
+		}
+		CloseHandle(file);
+
+		if (!result)
+			return false;
+
+		// byte order mark of utf-8
+		if (bytes.compare(0, 3, "\xEF\xBB\xBF") == 0)
+			bytes.erase(0, 3);
+
+		tstring script;
+#ifdef UNICODE
+		auto length = MultiByteToWideChar(CP_UTF8, 0, bytes.data(), static_cast<int>(bytes.size()), nullptr, 0);
+		if (length > 0)
+		{
+			script.resize(length);
+			MultiByteToWideChar(CP_UTF8, 0, bytes.data(), static_cast<int>(bytes.size()), &script[0], length);
+		}
+#else
+		script = bytes;
+#endif
+
+		results = Run(script);
+		return true;
+	}
+
+	const TCHAR* BatchRunner::GetStatusName(BatchStatus status)
+	{
+		switch (status)
+		{
+		case bs_success:
+			return _T("ok");
+		case bs_failure:
+			return _T("failed");
+		case bs_not_found:
+			return _T("not found");
+		case bs_no_callback:
+			return _T("no callback");
+		}
+		return _T("");
+	}
+
+	void BatchRunner::RunGroup(const std::vector<Step>& group, Result* results)
+	{
+		// lazy nodes are expanded by lookup, it is not done concurrently
+		std::vector<std::shared_ptr<MenuItem>> items;
+		items.reserve(group.size());
+		for (auto&& step : group)
+			items.emplace_back(_root.FindPath(step.path));
+
+		// steps of the same item run one after another on one worker, callback is not run concurrently with itself
+		std::vector<std::vector<size_t>> runs;
+		std::unordered_map<const MenuItem*, size_t> runOfItem;
+		for (size_t i = 0u; i < group.size(); ++i)
+		{
+			auto run = runOfItem.find(items[i].get());
+			if (items[i] && run != runOfItem.end())
+			{
+				runs[run->second].emplace_back(i);
+				continue;
+			}
+
+			if (items[i])
+				runOfItem.emplace(items[i].get(), runs.size());
+			runs.emplace_back(1u, i);
+		}
+
+		std::atomic<size_t> next{ 0u };
+		auto worker = [&]()
+		{
+			for (auto run = next++; run < runs.size(); run = next++)
+			{
+				for (auto i : runs[run])
+				{
+					auto& result = results[i];
+					result.path = group[i].path;
+					result.line = group[i].line;
+					result.duration = std::chrono::microseconds(0);
+
+					auto& item = items[i];
+					if (!item)
+					{
+						result.status = bs_not_found;
+						continue;
+					}
+
+					if (!item->HasCallback())
+					{
+						result.status = bs_no_callback;
+						continue;
+					}
+
+					auto start = std::chrono::steady_clock::now();
+					auto success = item->InvokeCallback();
+					result.duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+					result.status = success ? bs_success : bs_failure;
+					result.message = item->GetMessage(success);
+				}
+			}
+		};
+
+		// calling thread is one of workers
+		std::vector<std::thread> threads;
+		auto count = std::min(_parallelism, runs.size());
+		for (size_t i = 1u; i < count; ++i)
+			threads.emplace_back(worker);
+
+		worker();
+
+		for (auto&& thread : threads)
+			thread.join();
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <windows.h>
+#include <TCHAR.h>
+
+namespace Menu
+{
+	class MenuNode;
+
+	// Runner of callbacks of items given by script of paths, menu is not drawn and keys are not read.
+	// Script has a path of captions per line, "main/Node 1/Item 3", empty lines and lines starting with '#' are skipped.
+	// Separator in caption is escaped as in PathIndex.
+	// Line ending with '&' runs together with the next line, steps of such group run in parallel.
+	// Steps of group with the same item run one after another, callback does not run concurrently with itself.
+	// Group starts when previous one is finished, paths of group are resolved just before it starts.
+	class BatchRunner
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+
+		enum BatchStatus
+		{
+			bs_success,
+			bs_failure,
+			// path is not found in menu tree
+			bs_not_found,
+			// item has no callback
+			bs_no_callback,
+		};
+
+		// outcome of one line of script
+		struct Result
+		{
+			tstring path;
+			// line of script, starting from 1
+			size_t line;
+			BatchStatus status;
+			// success or error message of item
+			tstring message;
+			std::chrono::microseconds duration;
+		};
+
+		// c-tor, enables path index of root, parallelism 0 uses count of hardware threads
+		BatchRunner(MenuNode& root, size_t parallelism = 0u);
+
+		// run script, return results in order of lines
+		std::vector<Result> Run(const tstring& script);
+
+		// run script from utf-8 file, return false if file can not be read
+		bool RunFile(const tstring& path, std::vector<Result>& results);
+
+		// return name of status
+		static const TCHAR* GetStatusName(BatchStatus status);
+
+	private:
+
+		// line of script
+		struct Step
+		{
+			tstring path;
+			size_t line;
+		};
+
+		// run steps of group, results are written to the same positions
+		void RunGroup(const std::vector<Step>& group, Result* results);
+
+		MenuNode& _root;
+		size_t _parallelism;
+	};
+}
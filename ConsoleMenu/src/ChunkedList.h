@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <iterator>
+
+namespace Menu
+{
+	// List of values kept in chunks shared between copies of the list.
+	// Copy takes pointers of chunks, chunk is copied before it is changed if other list shares it,
+	// so appending to a copy of long list copies pointers and at most one chunk instead of all values.
+	// All chunks but the last one are full, position is found by division.
+	// Chunks shared by lists of other threads are never changed, the list itself is not synchronized.
+	template <class T, size_t ChunkSize = 128u>
+	class ChunkedList
+	{
+	public:
+
+		class const_iterator
+		{
+		public:
+
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type = T;
+			using difference_type = ptrdiff_t;
+			using pointer = const T*;
+			using reference = const T&;
+
+			const_iterator() = default;
+			const_iterator(const ChunkedList* list, size_t position) :_list(list), _position(position) {}
+
+			reference operator*() const { return (*_list)[_position]; }
+			pointer operator->() const { return &(*_list)[_position]; }
+			reference operator[](difference_type offset) const { return (*_list)[_position + offset]; }
+
+			const_iterator& operator++() { ++_position; return *this; }
+			const_iterator operator++(int) { auto it = *this; ++_position; return it; }
+			const_iterator& operator--() { --_position; return *this; }
+			const_iterator operator--(int) { auto it = *this; --_position; return it; }
+
+			const_iterator& operator+=(difference_type offset) { _position += offset; return *this; }
+			const_iterator& operator-=(difference_type offset) { _position -= offset; return *this; }
+			const_iterator operator+(difference_type offset) const { return const_iterator(_list, _position + offset); }
+			const_iterator operator-(difference_type offset) const { return const_iterator(_list, _position - offset); }
+			friend const_iterator operator+(difference_type offset, const const_iterator& it) { return it + offset; }
+			difference_type operator-(const const_iterator& other) const { return difference_type(_position) - difference_type(other._position); }
+
+			bool operator==(const const_iterator& other) const { return _position == other._position; }
+			bool operator!=(const const_iterator& other) const { return _position != other._position; }
+			bool operator<(const const_iterator& other) const { return _position < other._position; }
+			bool operator>(const const_iterator& other) const { return _position > other._position; }
+			bool operator<=(const const_iterator& other) const { return _position <= other._position; }
+			bool operator>=(const const_iterator& other) const { return _position >= other._position; }
+
+		private:
+
+			const ChunkedList* _list{ nullptr };
+			size_t _position{ 0u };
+		};
+
+		// values are changed only by the list, chunks may be shared
+		using iterator = const_iterator;
+
+		ChunkedList() = default;
+
+		template <class Iterator>
+		ChunkedList(Iterator first, Iterator last)
+		{
+			for (; first != last; ++first)
+				push_back(*first);
+		}
+
+		size_t size() const { return _size; }
+		bool empty() const { return _size == 0u; }
+
+		const T& operator[](size_t position) const { return (*_chunks[position / ChunkSize])[position % ChunkSize]; }
+		const T& front() const { return (*this)[0u]; }
+		const T& back() const { return (*this)[_size - 1]; }
+
+		const_iterator begin() const { return const_iterator(this, 0u); }
+		const_iterator end() const { return const_iterator(this, _size); }
+		const_iterator cbegin() const { return begin(); }
+		const_iterator cend() const { return end(); }
+
+		void push_back(T value)
+		{
+			if (_size % ChunkSize == 0u)
+			{
+				_chunks.emplace_back(std::make_shared<Chunk>());
+				_chunks.back()->reserve(ChunkSize);
+			}
+			else if (_chunks.back().use_count() > 1)
+			{
+				// the last chunk is shared with other copy
+				auto chunk = std::make_shared<Chunk>();
+				chunk->reserve(ChunkSize);
+				chunk->assign(_chunks.back()->begin(), _chunks.back()->end());
+				_chunks.back() = std::move(chunk);
+			}
+
+			_chunks.back()->emplace_back(std::move(value));
+			++_size;
+		}
+
+		void emplace_back(T value) { push_back(std::move(value)); }
+
+		void clear()
+		{
+			_chunks.clear();
+			_size = 0u;
+		}
+
+		// copy of values, e.g. to return them to caller
+		std::vector<T> ToVector() const { return std::vector<T>(begin(), end()); }
+
+		bool operator==(const ChunkedList& other) const
+		{
+			if (_size != other._size)
+				return false;
+
+			for (size_t i = 0u; i < _chunks.size(); ++i)
+			{
+				if (_chunks[i] != other._chunks[i] && *_chunks[i] != *other._chunks[i])
+					return false;
+			}
+			return true;
+		}
+
+		bool operator!=(const ChunkedList& other) const { return !(*this == other); }
+
+	private:
+
+		using Chunk = std::vector<T>;
+
+		std::vector<std::shared_ptr<Chunk>> _chunks;
+		size_t _size{ 0u };
+	};
+}
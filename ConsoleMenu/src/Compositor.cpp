@@ -0,0 +1,374 @@
+#include "Compositor.h"
+#include "ConsoleGeometry.h"
+#include "TextWidth.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+namespace Menu {
+
+	namespace
+	{
+		// visible columns [first, second) of the row
+		using Spans = std::vector<std::pair<int, int>>;
+
+		// keep only columns inside [left, right)
+		void Clip(Spans& spans, int left, int right)
+		{
+			Spans clipped;
+			for (auto&& span : spans)
+			{
+				auto first = std::max(span.first, left);
+				auto second = std::min(span.second, right);
+				if (first < second)
+					clipped.emplace_back(first, second);
+			}
+			spans.swap(clipped);
+		}
+
+		// remove columns inside [left, right)
+		void Cut(Spans& spans, int left, int right)
+		{
+			Spans rest;
+			for (auto&& span : spans)
+			{
+				if (span.first < left)
+					rest.emplace_back(span.first, std::min(span.second, left));
+				if (span.second > right)
+					rest.emplace_back(std::max(span.first, right), span.second);
+			}
+			spans.swap(rest);
+		}
+
+		bool ContainsRow(const SMALL_RECT& rect, SHORT row)
+		{
+			return row >= rect.Top && row <= rect.Bottom && rect.Left <= rect.Right;
+		}
+
+		bool Intersects(const SMALL_RECT& left, const SMALL_RECT& right)
+		{
+			return left.Left <= right.Right && right.Left <= left.Right && left.Top <= right.Bottom && right.Top <= left.Bottom;
+		}
+	}
+
+	Compositor& Compositor::Instance()
+	{
+		static Compositor compositor;
+		return compositor;
+	}
+
+	void Compositor::Unregister(Surface* surface)
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+
+		auto entry = Find(surface);
+		if (entry == _entries.end())
+			return;
+
+		auto level = size_t(entry - _entries.begin());
+		_levels.erase(surface);
+		_entries.erase(entry);
+		Renumber(level, _entries.size());
+	}
+
+	void Compositor::SetRect(Surface* surface, SMALL_RECT rect, bool visible)
+	{
+		if (!visible)
+		{
+			Unregister(surface);
+			return;
+		}
+
+		std::lock_guard<std::mutex> lk(_mutex);
+
+		auto entry = Find(surface);
+		if (entry != _entries.end())
+		{
+			entry->rect = rect;
+			return;
+		}
+
+		_levels.emplace(surface, _entries.size());
+		_entries.emplace_back(Entry{ surface, rect });
+	}
+
+	void Compositor::Raise(Surface* surface)
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+
+		auto entry = Find(surface);
+		if (entry == _entries.end())
+			return;
+
+		auto level = size_t(entry - _entries.begin());
+		std::rotate(entry, entry + 1, _entries.end());
+		Renumber(level, _entries.size());
+	}
+
+	void Compositor::Lower(Surface* surface)
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+
+		auto entry = Find(surface);
+		if (entry == _entries.end())
+			return;
+
+		auto level = size_t(entry - _entries.begin());
+		std::rotate(_entries.begin(), entry, entry + 1);
+		Renumber(0u, level + 1);
+	}
+
+	void Compositor::Write(const Surface* surface, HANDLE output, tcout& stream, COORD coord, const tstring& text)
+	{
+		static const std::vector<StyleSpan> plain;
+		Write(surface, output, stream, coord, text, plain);
+	}
+
+	void Compositor::Write(const Surface* surface, HANDLE output, tcout& stream, COORD coord, const StyledText& text)
+	{
+		Write(surface, output, stream, coord, text.GetText(), text.GetSpans());
+	}
+
+	void Compositor::Present(HANDLE output, tcout& stream)
+	{
+		if (_encoder)
+		{
+			TraceSpan span("Compositor::Present", "render");
+			Metrics::Add(Metric::m_bytes_written, _encoder->Present(stream));
+			stream.flush();
+		}
+		else if (_attributesKnown)
+		{
+			SetAttributes(output, stream, _defaults);
+		}
+	}
+
+	bool Compositor::EnableEncoder(HANDLE output, bool enable)
+	{
+		if (!enable)
+		{
+			_encoder.reset();
+			return true;
+		}
+
+		DWORD mode = 0;
+		if (!GetConsoleMode(output, &mode) || !SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING))
+			return false;
+
+		QueryAttributes(output);
+
+		_encoder = std::make_unique<OutputEncoder>();
+		_encoder->SetDefaultAttributes(_defaults);
+		_encoder->Resize(ConsoleGeometry::GetSize());
+		_encoderGeneration = ConsoleGeometry::GetGeneration();
+		return true;
+	}
+
+	OutputEncoder::Statistics Compositor::GetEncoderStatistics() const
+	{
+		if (!_encoder)
+			return OutputEncoder::Statistics{ 0u, 0u, 0u };
+
+		return _encoder->GetStatistics();
+	}
+
+	void Compositor::Write(const Surface* surface, HANDLE output, tcout& stream, COORD coord, const tstring& text, const std::vector<StyleSpan>& spans)
+	{
+		if (output == nullptr || text.empty() || coord.Y < 0)
+			return;
+
+		auto width = int(Text::Width(text));
+		Spans visible{ { coord.X, coord.X + width } };
+		{
+			std::lock_guard<std::mutex> lk(_mutex);
+
+			Clip(visible, 0, ConsoleGeometry::GetSize().X);
+
+			if (_damaged)
+			{
+				if (!ContainsRow(_damage, coord.Y))
+					return;
+				Clip(visible, _damage.Left, _damage.Right + 1);
+			}
+
+			// surfaces above are covering, surface which is not on screen draws nothing
+			auto above = _entries.begin();
+			if (surface)
+			{
+				auto own = Find(surface);
+				if (own == _entries.end() || !ContainsRow(own->rect, coord.Y))
+					return;
+
+				Clip(visible, own->rect.Left, own->rect.Right + 1);
+				above = own + 1;
+			}
+
+			for (auto entry = above; entry != _entries.end() && !visible.empty(); ++entry)
+			{
+				if (ContainsRow(entry->rect, coord.Y))
+					Cut(visible, entry->rect.Left, entry->rect.Right + 1);
+			}
+		}
+
+		if (visible.empty())
+			return;
+
+		QueryAttributes(output);
+
+		// screen model is rebuilt for new console size, resize handling redraws everything
+		if (_encoder && _encoderGeneration != ConsoleGeometry::GetGeneration())
+		{
+			_encoder->Resize(ConsoleGeometry::GetSize());
+			_encoderGeneration = ConsoleGeometry::GetGeneration();
+		}
+
+		for (auto&& span : visible)
+		{
+			Metrics::Add(Metric::m_cells_written, span.second - span.first);
+
+			COORD at{ static_cast<SHORT>(span.first), coord.Y };
+			if (!_encoder)
+				SetConsoleCursorPosition(output, at);
+
+			if (span.first == coord.X && span.second == coord.X + width)
+			{
+				Emit(output, stream, at, text, spans, 0u, text.length());
+				continue;
+			}
+
+			// columns of span relative to text
+			size_t left = span.first - coord.X;
+			size_t right = span.second - coord.X;
+
+			size_t first = 0u;
+			auto firstColumn = Text::Measure(text, 0u, text.length(), left, &first);
+
+			// wide character crossing left edge is skipped
+			if (firstColumn < left && first < text.length())
+				firstColumn += Text::Measure(text, first, text.length(), 2u, &first);
+
+			size_t last = first;
+			auto lastColumn = firstColumn;
+			if (right > firstColumn)
+				lastColumn += Text::Measure(text, first, text.length(), right - firstColumn, &last);
+
+			// cells of cut wide characters are blank
+			auto lead = std::min(std::max(firstColumn, left), right) - left;
+			auto trail = right > lastColumn ? right - lastColumn : 0u;
+
+			if (lead)
+				Put(output, stream, at, tstring(lead, _T(' ')), _defaults);
+
+			Emit(output, stream, at, text, spans, first, last);
+
+			if (trail)
+				Put(output, stream, at, tstring(trail, _T(' ')), _defaults);
+		}
+	}
+
+	void Compositor::Emit(HANDLE output, tcout& stream, COORD& coord, const tstring& text, const std::vector<StyleSpan>& spans, size_t first, size_t last)
+	{
+		if (spans.empty())
+		{
+			Put(output, stream, coord, text.substr(first, last - first), _defaults);
+			return;
+		}
+
+		size_t position = 0u;
+		for (auto&& span : spans)
+		{
+			auto begin = std::max<size_t>(position, first);
+			auto end = std::min<size_t>(position + span.length, last);
+			if (begin < end)
+				Put(output, stream, coord, text.substr(begin, end - begin), span.style.ToAttributes(_defaults));
+
+			position += span.length;
+			if (position >= last)
+				break;
+		}
+	}
+
+	void Compositor::Put(HANDLE output, tcout& stream, COORD& coord, const tstring& text, WORD attributes)
+	{
+		if (_encoder)
+		{
+			_encoder->Put(coord, text, attributes);
+			coord.X += static_cast<SHORT>(Text::Width(text));
+			return;
+		}
+
+		SetAttributes(output, stream, attributes);
+		stream << text;
+
+		// console takes characters as they are
+		Metrics::Add(Metric::m_bytes_written, text.length() * sizeof(TCHAR));
+	}
+
+	void Compositor::SetAttributes(HANDLE output, tcout& stream, WORD attributes)
+	{
+		if (attributes == _attributes)
+			return;
+
+		// written text takes attributes set at the moment of output
+		stream.flush();
+		SetConsoleTextAttribute(output, attributes);
+		_attributes = attributes;
+	}
+
+	void Compositor::QueryAttributes(HANDLE output)
+	{
+		if (_attributesKnown)
+			return;
+
+		CONSOLE_SCREEN_BUFFER_INFO csbi;
+		_defaults = GetConsoleScreenBufferInfo(output, &csbi) ? csbi.wAttributes : WORD(0x07);
+		_attributes = _defaults;
+		_attributesKnown = true;
+	}
+
+	void Compositor::Reveal(HANDLE output, tcout& stream, SMALL_RECT rect, const Surface* except)
+	{
+		if (output == nullptr || rect.Left > rect.Right || rect.Top > rect.Bottom)
+			return;
+
+		std::vector<Surface*> surfaces;
+		{
+			std::lock_guard<std::mutex> lk(_mutex);
+
+			_damage = rect;
+			_damaged = true;
+
+			for (auto&& entry : _entries)
+			{
+				if (entry.surface != except && Intersects(entry.rect, rect))
+					surfaces.emplace_back(entry.surface);
+			}
+		}
+
+		tstring blank(rect.Right - rect.Left + 1, _T(' '));
+		for (auto row = rect.Top; row <= rect.Bottom; ++row)
+			Write(nullptr, output, stream, COORD{ rect.Left, row }, blank);
+
+		for (auto&& surface : surfaces)
+			surface->Recompose();
+
+		Present(output, stream);
+		stream.flush();
+
+		std::lock_guard<std::mutex> lk(_mutex);
+		_damaged = false;
+	}
+
+	std::vector<Compositor::Entry>::iterator Compositor::Find(const Surface* surface)
+	{
+		auto level = _levels.find(surface);
+		return level != _levels.end() ? _entries.begin() + level->second : _entries.end();
+	}
+
+	void Compositor::Renumber(size_t first, size_t last)
+	{
+		for (auto i = first; i < last; ++i)
+			_levels[_entries[i].surface] = i;
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <windows.h>
+#include <TCHAR.h>
+
+#include "Style.h"
+#include "OutputEncoder.h"
+
+namespace Menu
+{
+	// Part of console drawn through compositor.
+	class Surface
+	{
+	public:
+
+		// v d-tor
+		virtual ~Surface() = default;
+
+		// draw everything again, console is locked
+		// output outside of revealed area is dropped by compositor
+		virtual void Recompose() = 0;
+	};
+
+	// Owner of console cells.
+	// Only surfaces on screen are kept, a surface enters on top when its rectangle is set visible and leaves when it is hidden,
+	// so surfaces which are created but not shown cost nothing. Surfaces are ordered by z, the one shown or raised later is on top.
+	// Output of surface is clipped by its rectangle and by surfaces above it, so covered cells are never written,
+	// output of surface which is not on screen is dropped.
+	// Console attributes are changed only when the next written run needs other ones.
+	// With encoder enabled output is collected in a screen model and sent as
+	// virtual terminal sequences by Present.
+	// Write and Reveal are called with console locked.
+	class Compositor
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+		using tcout = std::basic_ostream<TCHAR, std::char_traits<TCHAR>>;
+
+		// return compositor of console
+		static Compositor& Instance();
+
+		// remove surface, its cells keep last output
+		void Unregister(Surface* surface);
+
+		// set rectangle of surface, visible surface is added on top if it is not on screen, hidden one is removed
+		void SetRect(Surface* surface, SMALL_RECT rect, bool visible);
+
+		// move surface on screen on top or to the bottom
+		void Raise(Surface* surface);
+		void Lower(Surface* surface);
+
+		// write text of surface at position skipping clipped cells, nullptr surface is background under all others
+		void Write(const Surface* surface, HANDLE output, tcout& stream, COORD coord, const tstring& text);
+		void Write(const Surface* surface, HANDLE output, tcout& stream, COORD coord, const StyledText& text);
+
+		// finish drawing: send encoded changes or restore attributes console started with
+		void Present(HANDLE output, tcout& stream);
+
+		// send output through virtual terminal encoder, call before drawing starts
+		// return false if console does not support virtual terminal sequences
+		bool EnableEncoder(HANDLE output, bool enable);
+
+		// return counters of encoded output, zeros if encoder is disabled
+		OutputEncoder::Statistics GetEncoderStatistics() const;
+
+		// draw area after surface above it was hidden or moved, except is not recomposed
+		// cells not covered by any surface are blanked
+		void Reveal(HANDLE output, tcout& stream, SMALL_RECT rect, const Surface* except = nullptr);
+
+	private:
+
+		struct Entry
+		{
+			Surface* surface;
+			SMALL_RECT rect;
+		};
+
+		// surfaces on screen from bottom to top
+		std::vector<Entry> _entries;
+
+		// position of surface in entries
+		std::unordered_map<const Surface*, size_t> _levels;
+
+		// area drawn by Reveal, output outside of it is dropped
+		SMALL_RECT _damage{ 0, 0, -1, -1 };
+		bool _damaged{ false };
+
+		std::mutex _mutex;
+
+		// attributes console started with
+		WORD _defaults{ 0u };
+
+		// attributes set now
+		WORD _attributes{ 0u };
+
+		// true if attributes were queried
+		bool _attributesKnown{ false };
+
+		// screen model of virtual terminal output, nullptr if console is written directly
+		std::unique_ptr<OutputEncoder> _encoder;
+
+		// console geometry generation encoder was sized for
+		uint32_t _encoderGeneration{ 0u };
+
+		// write runs of text, plain text if runs are empty
+		void Write(const Surface* surface, HANDLE output, tcout& stream, COORD coord, const tstring& text, const std::vector<StyleSpan>& spans);
+
+		// write characters [first, last) of text, coord is moved after them
+		void Emit(HANDLE output, tcout& stream, COORD& coord, const tstring& text, const std::vector<StyleSpan>& spans, size_t first, size_t last);
+
+		// write text of attributes to console or encoder, coord is moved after it
+		void Put(HANDLE output, tcout& stream, COORD& coord, const tstring& text, WORD attributes);
+
+		// change console attributes if they differ from current ones
+		void SetAttributes(HANDLE output, tcout& stream, WORD attributes);
+
+		// query attributes console started with once
+		void QueryAttributes(HANDLE output);
+
+		// return entry of surface or end
+		std::vector<Entry>::iterator Find(const Surface* surface);
+
+		// update levels of entries [first, last)
+		void Renumber(size_t first, size_t last);
+	};
+}
@@ -0,0 +1,58 @@
+#include "ConsoleGeometry.h"
+
+#include <atomic>
+
+namespace Menu {
+
+	namespace
+	{
+		// size used when output is not a console
+		const SHORT DefaultWidth{ 80 };
+		const SHORT DefaultHeight{ 25 };
+
+		// width in low and height in high half, 0 - not queried
+		std::atomic<uint32_t> cached_size{ 0u };
+
+		std::atomic<uint32_t> generation{ 0u };
+
+		uint32_t Pack(SHORT width, SHORT height)
+		{
+			return uint32_t(uint16_t(width)) | uint32_t(uint16_t(height)) << 16;
+		}
+
+		uint32_t Query()
+		{
+			CONSOLE_SCREEN_BUFFER_INFO csbi;
+			if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi) == 0)
+				return Pack(DefaultWidth, DefaultHeight);
+
+			return Pack(csbi.dwSize.X, csbi.srWindow.Bottom - csbi.srWindow.Top + 1);
+		}
+	}
+
+	COORD ConsoleGeometry::GetSize()
+	{
+		auto size = cached_size.load();
+		if (size == 0u)
+		{
+			size = Query();
+			cached_size = size;
+		}
+		return COORD{ static_cast<SHORT>(size & 0xFFFF), static_cast<SHORT>(size >> 16) };
+	}
+
+	bool ConsoleGeometry::Refresh()
+	{
+		auto size = Query();
+		if (cached_size.exchange(size) == size)
+			return false;
+
+		++generation;
+		return true;
+	}
+
+	uint32_t ConsoleGeometry::GetGeneration()
+	{
+		return generation;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <windows.h>
+
+namespace Menu
+{
+	// Size of console cached between resize events.
+	// Width is the width of screen buffer, height is the height of visible window.
+	class ConsoleGeometry
+	{
+	public:
+
+		// return cached size, console is queried on the first call only
+		static COORD GetSize();
+
+		// query console again, return true if size changed
+		static bool Refresh();
+
+		// return counter of size changes
+		static uint32_t GetGeneration();
+	};
+}
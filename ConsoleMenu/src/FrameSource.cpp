@@ -0,0 +1,157 @@
+#include "FrameSource.h"
+#include "Trace.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MENU_SSE2_SCAN
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace Menu {
+
+	const char* FindNewline(const char* begin, const char* end)
+	{
+#ifdef MENU_SSE2_SCAN
+		// compare 16 bytes at once
+		const auto newline = _mm_set1_epi8('\n');
+		for (; end - begin >= 16; begin += 16)
+		{
+			auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+			auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+			if (mask)
+			{
+#ifdef _MSC_VER
+				unsigned long index;
+				_BitScanForward(&index, mask);
+				return begin + index;
+#else
+				return begin + __builtin_ctz(mask);
+#endif
+			}
+		}
+#endif
+		auto found = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+		return found ? found : end;
+	}
+
+	FrameSource::FrameSource(std::shared_ptr<MenuFrame> frame, HANDLE handle, bool follow, UINT codePage)
+		:_frame(frame), _handle(handle), _follow(follow), _codePage(codePage)
+	{
+		_thread = std::thread(&FrameSource::Run, this);
+	}
+
+	FrameSource::~FrameSource()
+	{
+		Stop();
+
+		if (_handle != INVALID_HANDLE_VALUE)
+			CloseHandle(_handle);
+	}
+
+	std::unique_ptr<FrameSource> FrameSource::Open(std::shared_ptr<MenuFrame> frame, const tstring& path, bool follow, UINT codePage)
+	{
+		auto handle = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (handle == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		return std::make_unique<FrameSource>(frame, handle, follow, codePage);
+	}
+
+	void FrameSource::Stop()
+	{
+		_running = false;
+
+		if (_thread.joinable())
+		{
+			// wake up reading blocked on pipe, cancel is lost if thread is not in ReadFile yet
+			// so it is repeated until thread sees the flag and exits
+			auto thread = _thread.native_handle();
+			do
+			{
+				CancelSynchronousIo(thread);
+			} while (WaitForSingleObject(thread, CancelRetryDelay) == WAIT_TIMEOUT);
+
+			_thread.join();
+		}
+	}
+
+	bool FrameSource::IsRunning() const
+	{
+		return _running;
+	}
+
+	uint64_t FrameSource::GetBytesRead() const
+	{
+		return _bytesRead;
+	}
+
+	void FrameSource::Run()
+	{
+		Trace::SetThreadName("FrameSource");
+
+		// the tail of the previous chunk without new line is kept at the beginning
+		std::vector<char> buffer(ChunkSize);
+		size_t pending = 0u;
+
+		std::vector<LineView> lines;
+
+		while (_running)
+		{
+			// line longer than buffer
+			if (pending == buffer.size())
+				buffer.resize(buffer.size() * 2);
+
+			DWORD read = 0;
+			auto result = ReadFile(_handle, buffer.data() + pending, static_cast<DWORD>(buffer.size() - pending), &read, nullptr);
+
+			if (result == 0 || read == 0)
+			{
+				// end of followed file, wait for writer
+				if (result != 0 && _follow)
+				{
+					Sleep(FollowDelay);
+					continue;
+				}
+
+				// end of pipe or file, last line may have no new line
+				if (pending)
+				{
+					LineView line{ buffer.data(), pending };
+					_frame->AddLines(&line, 1u, _codePage);
+				}
+				break;
+			}
+
+			_bytesRead += read;
+
+			const char* begin = buffer.data();
+			auto end = buffer.data() + pending + read;
+
+			lines.clear();
+			for (auto newline = FindNewline(begin, end); newline != end; newline = FindNewline(begin, end))
+			{
+				auto size = size_t(newline - begin);
+				if (size && begin[size - 1] == '\r')
+					--size;
+
+				lines.emplace_back(LineView{ begin, size });
+				begin = newline + 1;
+			}
+
+			// whole chunk goes to the frame with single update
+			_frame->AddLines(lines.data(), lines.size(), _codePage);
+
+			pending = end - begin;
+			if (pending && begin != buffer.data())
+				std::memmove(buffer.data(), begin, pending);
+		}
+
+		_running = false;
+	}
+}
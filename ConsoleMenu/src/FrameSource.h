@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Menu.h"
+
+#include <atomic>
+#include <thread>
+
+namespace Menu
+{
+	// Feeds MenuFrame from file, pipe or FIFO handle on its own thread.
+	// Input is read in large chunks, lines are split in place and passed to the frame as views.
+	class FrameSource
+	{
+	public:
+
+		// c-tor, takes ownership of handle and starts reading
+		// follow - keep waiting for new data at the end of file like tail -f
+		FrameSource(std::shared_ptr<MenuFrame> frame, HANDLE handle, bool follow = false, UINT codePage = CP_UTF8);
+
+		// d-tor, stops reading and closes handle
+		~FrameSource();
+
+		FrameSource(const FrameSource&) = delete;
+		FrameSource& operator=(const FrameSource&) = delete;
+
+		// open file and attach it to frame, return nullptr if file cannot be opened
+		static std::unique_ptr<FrameSource> Open(std::shared_ptr<MenuFrame> frame, const tstring& path, bool follow = false, UINT codePage = CP_UTF8);
+
+		// stop reading, blocks until reading thread exits
+		void Stop();
+
+		// return true while input is not finished
+		bool IsRunning() const;
+
+		// return count of bytes read
+		uint64_t GetBytesRead() const;
+
+	private:
+
+		// size of single read
+		static const size_t ChunkSize{ 1u << 20 };
+
+		// delay before next read at the end of followed file
+		static const DWORD FollowDelay{ 100u };
+
+		// delay before cancelling read again when stopping
+		static const DWORD CancelRetryDelay{ 10u };
+
+		std::shared_ptr<MenuFrame> _frame;
+
+		HANDLE _handle{ INVALID_HANDLE_VALUE };
+
+		bool _follow{ false };
+
+		UINT _codePage{ CP_UTF8 };
+
+		std::atomic<bool> _running{ true };
+
+		std::atomic<uint64_t> _bytesRead{ 0u };
+
+		std::thread _thread;
+
+		// reading loop
+		void Run();
+	};
+
+	// return pointer to the first '\n' in [begin, end) or end
+	const char* FindNewline(const char* begin, const char* end);
+}
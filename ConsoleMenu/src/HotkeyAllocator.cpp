@@ -0,0 +1,78 @@
+#include "HotkeyAllocator.h"
+
+namespace Menu {
+
+	HotkeyAllocator HotkeyAllocator::Letters()
+	{
+		Keys keys;
+		for (size_t key = 'A'; key <= 'Z'; ++key)
+			keys.set(key);
+		for (size_t key = '0'; key <= '9'; ++key)
+			keys.set(key);
+		return HotkeyAllocator(keys);
+	}
+
+	HotkeyAllocator HotkeyAllocator::Numbers()
+	{
+		Keys keys;
+		for (size_t key = 1u; key <= 9u; ++key)
+			keys.set(key);
+		return HotkeyAllocator(keys);
+	}
+
+	HotkeyAllocator HotkeyAllocator::FxKeys()
+	{
+		// F1-F10 are 59-68, F11 and F12 are 133 and 134
+		Keys keys;
+		for (size_t key = 59u; key <= 68u; ++key)
+			keys.set(key);
+		keys.set(133u);
+		keys.set(134u);
+		return HotkeyAllocator(keys);
+	}
+
+	bool HotkeyAllocator::Take(size_t key)
+	{
+		if (!IsFree(key))
+			return false;
+
+		_taken.set(key);
+		return true;
+	}
+
+	size_t HotkeyAllocator::TakeFromCaption(const tstring& caption)
+	{
+		for (auto letter : caption)
+		{
+			// characters outside of ascii are not keys
+			size_t key = static_cast<size_t>(letter);
+			if (key >= 'a' && key <= 'z')
+				key -= 'a' - 'A';
+
+			if (Take(key))
+				return key;
+		}
+		return 0u;
+	}
+
+	size_t HotkeyAllocator::TakeLowest()
+	{
+		for (size_t key = 1u; key < KeyCount; ++key)
+		{
+			if (Take(key))
+				return key;
+		}
+		return 0u;
+	}
+
+	void HotkeyAllocator::Release(size_t key)
+	{
+		if (key < KeyCount)
+			_taken.reset(key);
+	}
+
+	bool HotkeyAllocator::IsFree(size_t key) const
+	{
+		return key > 0u && key < KeyCount && _allowed.test(key) && !_taken.test(key);
+	}
+}
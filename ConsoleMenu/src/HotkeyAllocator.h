@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <bitset>
+#include <windows.h>
+#include <TCHAR.h>
+
+namespace Menu
+{
+	// Free keys of one key space of hotkeys.
+	// Keys are codes processed by MenuNode: letters, numbers or Fx scan codes, all of them are below KeyCount.
+	// Allowed and taken keys are kept in bitsets, so taking a key by caption is linear in its length.
+	class HotkeyAllocator
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+
+		static const size_t KeyCount{ 256u };
+
+		using Keys = std::bitset<KeyCount>;
+
+		// c-tor, no key is allowed
+		HotkeyAllocator() = default;
+
+		// c-tor
+		explicit HotkeyAllocator(const Keys& allowed) :_allowed(allowed) {}
+
+		// letters A-Z and digits 0-9
+		static HotkeyAllocator Letters();
+
+		// numbers 1-9
+		static HotkeyAllocator Numbers();
+
+		// scan codes of F1-F12
+		static HotkeyAllocator FxKeys();
+
+		// take key if it is allowed and free
+		bool Take(size_t key);
+
+		// take the first free character of caption, letters are taken upper case, return 0 if none is free
+		size_t TakeFromCaption(const tstring& caption);
+
+		// take the lowest free key, return 0 if none is free
+		size_t TakeLowest();
+
+		// make taken key free
+		void Release(size_t key);
+
+		// return true if key is allowed and free
+		bool IsFree(size_t key) const;
+
+		// make all keys free
+		void Clear() { _taken.reset(); }
+
+	private:
+
+		Keys _allowed;
+		Keys _taken;
+	};
+}
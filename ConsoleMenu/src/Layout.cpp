@@ -0,0 +1,141 @@
+#include "Layout.h"
+
+namespace Menu {
+
+	namespace
+	{
+		bool IsSame(const SMALL_RECT& left, const SMALL_RECT& right)
+		{
+			return left.Left == right.Left && left.Top == right.Top && left.Right == right.Right && left.Bottom == right.Bottom;
+		}
+	}
+
+	Layout::Layout(Direction direction) :_direction(direction)
+	{
+	}
+
+	void Layout::AddFrame(std::shared_ptr<MenuFrame> frame, Extent extent)
+	{
+		_children.emplace_back(Child{ extent, frame, nullptr, SMALL_RECT{ 0, 0, -1, -1 } });
+		_dirty = true;
+	}
+
+	std::shared_ptr<Layout> Layout::AddSplit(Direction direction, Extent extent)
+	{
+		auto split = std::make_shared<Layout>(direction);
+		_children.emplace_back(Child{ extent, nullptr, split, SMALL_RECT{ 0, 0, -1, -1 } });
+		_dirty = true;
+		return split;
+	}
+
+	std::vector<std::shared_ptr<MenuFrame>> Layout::GetFrames() const
+	{
+		std::vector<std::shared_ptr<MenuFrame>> frames;
+		for (auto&& child : _children)
+		{
+			if (child.frame)
+			{
+				frames.emplace_back(child.frame);
+			}
+			else
+			{
+				auto nested = child.split->GetFrames();
+				frames.insert(frames.end(), nested.begin(), nested.end());
+			}
+		}
+		return frames;
+	}
+
+	bool Layout::IsDirty() const
+	{
+		if (_dirty)
+			return true;
+
+		for (auto&& child : _children)
+		{
+			if (child.split && child.split->IsDirty())
+				return true;
+		}
+		return false;
+	}
+
+	std::vector<std::shared_ptr<MenuFrame>> Layout::Arrange(SMALL_RECT area)
+	{
+		std::vector<std::shared_ptr<MenuFrame>> changed;
+		Place(area, changed);
+		return changed;
+	}
+
+	void Layout::Place(SMALL_RECT area, std::vector<std::shared_ptr<MenuFrame>>& changed)
+	{
+		// nested splits may still have new children
+		if (!_dirty && IsSame(area, _area))
+		{
+			for (auto&& child : _children)
+			{
+				if (child.split)
+					child.split->Place(child.rect, changed);
+			}
+			return;
+		}
+
+		_area = area;
+		_dirty = false;
+
+		auto horizontal = _direction == Direction::d_horizontal;
+		auto start = horizontal ? area.Left : area.Top;
+		auto end = (horizontal ? area.Right : area.Bottom) + 1;
+		auto length = end > start ? end - start : 0;
+
+		// fixed children first, weighted ones share the rest
+		auto fixed = 0;
+		auto weights = 0;
+		for (auto&& child : _children)
+		{
+			if (child.extent.weight)
+				weights += child.extent.weight;
+			else
+				fixed += child.extent.cells;
+		}
+
+		auto free = length > fixed ? length - fixed : 0;
+		auto distributed = 0;
+		auto weighted = 0;
+		auto position = start;
+
+		for (auto&& child : _children)
+		{
+			auto size = int(child.extent.cells);
+			if (child.extent.weight)
+			{
+				// the last weighted child takes rounding remainder
+				weighted += child.extent.weight;
+				size = weighted == weights ? free - distributed : free * child.extent.weight / weights;
+				distributed += size;
+			}
+
+			// children which do not fit are collapsed at the end
+			if (size > end - position)
+				size = end - position;
+			if (size < 0)
+				size = 0;
+
+			SMALL_RECT rect = horizontal
+				? SMALL_RECT{ static_cast<SHORT>(position), area.Top, static_cast<SHORT>(position + size - 1), area.Bottom }
+				: SMALL_RECT{ area.Left, static_cast<SHORT>(position), area.Right, static_cast<SHORT>(position + size - 1) };
+			position += size;
+
+			if (child.split)
+			{
+				child.rect = rect;
+				child.split->Place(rect, changed);
+			}
+			else if (!IsSame(rect, child.rect))
+			{
+				child.rect = rect;
+				child.frame->SetGeometry(rect.Left, rect.Top, static_cast<short>(std::max(rect.Right - rect.Left + 1, 0)), static_cast<short>(std::max(rect.Bottom - rect.Top + 1, 0)));
+				changed.emplace_back(child.frame);
+			}
+		}
+	}
+}
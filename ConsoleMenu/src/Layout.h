@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Menu.h"
+
+namespace Menu
+{
+	// Split of console area between frames.
+	// Every split divides its rectangle between children side by side or stacked,
+	// children are frames or nested splits. Rectangles are cached and recomputed
+	// only for splits whose rectangle or children changed.
+	// Not thread safe, used by thread processing keys.
+	class Layout
+	{
+	public:
+
+		enum class Direction
+		{
+			// children side by side
+			d_horizontal,
+			// children one under another
+			d_vertical,
+		};
+
+		// length of child along split direction
+		struct Extent
+		{
+			// fixed count of cells, used if weight is 0
+			short cells;
+
+			// share of space left after fixed children
+			short weight;
+
+			// fixed count of cells
+			static Extent Fixed(short cells) { return Extent{ cells, 0 }; }
+
+			// share of free space
+			static Extent Fill(short weight = 1) { return Extent{ 0, weight }; }
+		};
+
+		// c-tor
+		explicit Layout(Direction direction);
+
+		// add frame as the next child
+		void AddFrame(std::shared_ptr<MenuFrame> frame, Extent extent = Extent::Fill());
+
+		// add nested split as the next child, return it
+		std::shared_ptr<Layout> AddSplit(Direction direction, Extent extent = Extent::Fill());
+
+		// return frames of this and nested splits
+		std::vector<std::shared_ptr<MenuFrame>> GetFrames() const;
+
+		// return true if children were added after the last arrangement
+		bool IsDirty() const;
+
+		// place children inside area, geometry of moved frames is changed
+		// return frames which have to be repainted
+		std::vector<std::shared_ptr<MenuFrame>> Arrange(SMALL_RECT area);
+
+	private:
+
+		struct Child
+		{
+			Extent extent;
+			std::shared_ptr<MenuFrame> frame;
+			std::shared_ptr<Layout> split;
+
+			// rectangle given by the last arrangement
+			SMALL_RECT rect;
+		};
+
+		Direction _direction;
+
+		std::vector<Child> _children;
+
+		// rectangle of the last arrangement
+		SMALL_RECT _area{ 0, 0, -1, -1 };
+
+		// children changed after the last arrangement
+		bool _dirty{ true };
+
+		// place children inside area collecting frames to repaint
+		void Place(SMALL_RECT area, std::vector<std::shared_ptr<MenuFrame>>& changed);
+	};
+}
@@ -1,4 +1,8 @@
 #include "Menu.h"
+#include "Layout.h"
+#include "Metrics.h"
+#include "MetricsFrame.h"
+#include "Trace.h"
 
 #include <iostream> // cout
 #include <conio.h>
@@ -6,11 +10,60 @@
 #include <iomanip>
 #include <cctype>
 #include <cassert>
+#include <unordered_map>
+#include <unordered_set>
+#include <typeinfo>
 
 namespace Menu {
 
 	std::mutex global_set_pos_mutex;
 
+	namespace
+	{
+		// keys which do not produce code for getch
+		bool IsModifierKey(WORD key)
+		{
+			return key == VK_SHIFT || key == VK_CONTROL || key == VK_MENU || key == VK_CAPITAL
+				|| key == VK_NUMLOCK || key == VK_SCROLL || key == VK_LWIN || key == VK_RWIN;
+		}
+
+		// wait until getch has key to read, console input events ignored by getch are consumed
+		// return true if console was resized instead
+		bool WaitForKey()
+		{
+			auto input = GetStdHandle(STD_INPUT_HANDLE);
+
+			// input is not console, getch reads it as is
+			DWORD mode = 0;
+			if (GetConsoleMode(input, &mode) == 0)
+				return false;
+
+			// resize events are reported only in window input mode
+			if ((mode & ENABLE_WINDOW_INPUT) == 0)
+				SetConsoleMode(input, mode | ENABLE_WINDOW_INPUT);
+
+			while (true)
+			{
+				INPUT_RECORD record;
+				DWORD count = 0;
+				if (WaitForSingleObject(input, INFINITE) != WAIT_OBJECT_0 || PeekConsoleInput(input, &record, 1, &count) == 0)
+					return false;
+
+				if (count == 0)
+					continue;
+
+				if (record.EventType == KEY_EVENT && record.Event.KeyEvent.bKeyDown && !IsModifierKey(record.Event.KeyEvent.wVirtualKeyCode))
+					return false;
+
+				if (ReadConsoleInput(input, &record, 1, &count) == 0)
+					return false;
+
+				if (record.EventType == WINDOW_BUFFER_SIZE_EVENT)
+					return true;
+			}
+		}
+	}
+
 	void MenuItem::SetContext(void* context)
 	{
 		_assotiatedContext = context;
@@ -19,9 +72,17 @@ namespace Menu {
 	MenuNode::MenuNode(const tstring& caption) :MenuItem(caption)
 	{
 		_alwaysShowMessage = false;
+		_reloadTarget->node = this;
 	}
 	MenuNode::~MenuNode()
 	{
+		// reload in progress is finished, trees built later are dropped
+		{
+			std::lock_guard<std::mutex> lk(_reloadTarget->mutex);
+			_reloadTarget->node = nullptr;
+		}
+
+		Compositor::Instance().Unregister(this);
 	}
 
 	void MenuItem::UnlockMessage()
@@ -36,7 +97,8 @@ namespace Menu {
 
 	void MenuItem::Select()
 	{
-		_isSelected = true;
+		if (!_isSelected.exchange(true))
+			++_selections;
 	}
 
 	void MenuItem::Release()
@@ -54,13 +116,36 @@ namespace Menu {
 		_isVisible = false;
 	}
 
-	void MenuItem::RunCallback()
+	bool MenuItem::RunCallback()
 	{
-		if (_callback)
-		{
-			_showMessage = true;
-			_callbackResult = _callback();
-		}
+		if (!_callback)
+			return false;
+
+		_showMessage = true;
+
+		auto result = InvokeCallback();
+		_callbackResult = result;
+		return result;
+	}
+
+	bool MenuItem::InvokeCallback()
+	{
+		if (!_callback)
+			return false;
+
+		TraceSpan span("RunCallback", "callback");
+
+		auto start = std::chrono::steady_clock::now();
+		auto result = _callback();
+
+		Metrics::Add(Metric::m_callbacks);
+		Metrics::Add(Metric::m_callback_time, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		return result;
+	}
+
+	bool MenuItem::HasCallback() const
+	{
+		return _callback != nullptr;
 	}
 
 	bool MenuItem::IsSelected() const
@@ -75,11 +160,13 @@ namespace Menu {
 
 	void MenuItem::SetErrorMessage(tstring message)
 	{
+		_errorWidth = Text::Width(message);
 		_errorMessage = message;
 	}
 
 	void MenuItem::SetSuccessMessage(tstring message)
 	{
+		_successWidth = Text::Width(message);
 		_successMessage = message;
 	}
 
@@ -89,6 +176,21 @@ namespace Menu {
 		return  _callbackResult ? _successMessage : _errorMessage;
 	}
 
+	const tstring& MenuItem::GetMessage(bool success) const
+	{
+		return success ? _successMessage : _errorMessage;
+	}
+
+	size_t MenuItem::GetMessageWidth(bool success) const
+	{
+		return success ? _successWidth : _errorWidth;
+	}
+
+	bool MenuItem::GetCallbackResult() const
+	{
+		return _callbackResult;
+	}
+
 	const tstring& MenuItem::GetCaption() const
 	{
 		return _caption;
@@ -101,7 +203,7 @@ namespace Menu {
 
 	size_t MenuItem::GetCaptionLength() const
 	{
-		return _caption.length();
+		return _captionWidth;
 	}
 
 	void MenuItem::SetHotkey(size_t code)
@@ -115,567 +217,2237 @@ namespace Menu {
 	}
 
 	void MenuNode::Add(std::shared_ptr<MenuItem> node)
+	{
+		Mutate([&](Snapshot& state)
+		{
+			Insert(state, node);
+
+			// assign hotkey
+			AssignHotkey(state, node);
+		});
+	}
+
+	void MenuNode::Add(std::shared_ptr<MenuItem> node, size_t hotkey)
+	{
+		Mutate([&](Snapshot& state)
+		{
+			Insert(state, node);
+
+			if (!state.allocator.Take(hotkey))
+				return;
+
+			state.hotkeys[hotkey] = node;
+			node->SetHotkey(GetHotkeyLabel(_hkpolicy, hotkey));
+		});
+	}
+
+	void MenuNode::AddRange(std::vector<std::shared_ptr<MenuItem>> nodes)
+	{
+		if (nodes.empty())
+			return;
+
+		Mutate([&](Snapshot& state)
+		{
+			for (auto&& node : nodes)
+			{
+				Insert(state, node);
+				AssignHotkey(state, node);
+			}
+		});
+
+		if (_isProcessing)
+			Draw(false);
+	}
+
+	void MenuNode::Insert(Snapshot& state, std::shared_ptr<MenuItem> node)
 	{
 		// add to vector
 		auto ptr = std::dynamic_pointer_cast<MenuNode>(node);
 		if (ptr)
 		{
 			ptr->SetMaxVisibleMenuItems(_maxVisibleItems);
+			ptr->SetItemStyles(_itemStyles);
 		}
 
-		_menuItems.emplace_back(node);
+		state.items.emplace_back(node);
+
+		if (_index)
+			Attach(node);
 
 		// change offset if needed
 		auto captionLength = node->GetCaptionLength();
-		if (_hotkeyOffset < captionLength)
-			_hotkeyOffset = captionLength;
+		if (state.hotkeyOffset < captionLength)
+			state.hotkeyOffset = captionLength;
 
 		// assign first as active if menu is empty
-		if (_menuItems.size() == 1)
-			SetFirtsSelected();
+		if (state.items.size() == 1)
+			node->Select();
+	}
 
-		// assign hotkey
-		AssignHotkey(_menuItems.back());
+	std::shared_ptr<const MenuNode::Snapshot> MenuNode::GetSnapshot() const
+	{
+		return std::atomic_load(&_snapshot);
 	}
-	void MenuNode::Draw()
+
+	void MenuNode::Mutate(const std::function<void(Snapshot&)>& change)
 	{
-		std::lock_guard<std::mutex>lc(_drawMutex);
+		std::lock_guard<std::recursive_mutex> lk(_writeMutex);
 
-		Clear();
+		// changes of batch are collected in one copy
+		if (!_pending)
+			_pending = std::make_shared<Snapshot>(*GetSnapshot());
+
+		// change may add items to this node again
+		++_batchDepth;
+		change(*_pending);
+		--_batchDepth;
+
+		if (_batchDepth == 0)
+			Publish();
+	}
+
+	void MenuNode::Publish()
+	{
+		std::atomic_store(&_snapshot, std::shared_ptr<const Snapshot>(std::move(_pending)));
+		_pending.reset();
+	}
+
+	void MenuNode::Batch(const std::function<void()>& changes)
+	{
+		std::lock_guard<std::recursive_mutex> lk(_writeMutex);
+
+		++_batchDepth;
+		changes();
+		--_batchDepth;
+
+		if (_batchDepth == 0 && _pending)
+			Publish();
+	}
 
-		// flag to resolve zero selection issue and multiple selection conflicts
-		auto isAnySelected = false;
+	void MenuNode::Reload(const MenuNode& source)
+	{
+		auto incoming = source.GetSnapshot();
+		auto changed = false;
 
-		for (auto it = _menuItems.begin(); it != _menuItems.end(); ++it)
+		Mutate([&](Snapshot& state)
 		{
-			// update deleted elements
-			if (it->get()->Deleted())
-			{
-				// set next selected
-				SetNextSelected();
+			// existing items by stable id, equal ids are matched in order
+			std::unordered_multimap<tstring, std::shared_ptr<MenuItem>> existing;
+			existing.reserve(state.items.size());
+			for (auto&& item : state.items)
+				existing.emplace(item->GetStableId(), item);
+
+			auto selected = GetSelectedMenuIterator(state.items);
+			auto selectedId = selected != state.items.end() ? selected->get()->GetStableId() : tstring();
+			auto selectedPosition = selected != state.items.end() ? size_t(selected - state.items.cbegin()) : 0u;
+
+			// new items replaced by kept ones
+			std::unordered_map<const MenuItem*, std::shared_ptr<MenuItem>> adopted;
+			adopted.reserve(incoming->items.size());
 
-				// if marked to delete remove element
-				it = _menuItems.erase(it);
+			Snapshot next;
+			next.hotkeyOffset = incoming->hotkeyOffset;
 
-				// on empty
-				if (_menuItems.empty())
+			for (auto&& item : incoming->items)
+			{
+				auto result = item;
+
+				auto match = existing.find(item->GetStableId());
+				if (match != existing.end())
 				{
-					OnBack();
-					return;
+					// nodes are kept, user may be inside of them
+					auto kept = std::dynamic_pointer_cast<MenuNode>(match->second);
+					auto update = std::dynamic_pointer_cast<MenuNode>(item);
+					if (kept && update && typeid(*kept) == typeid(MenuNode) && typeid(*update) == typeid(MenuNode) && kept->GetCaption() == update->GetCaption())
+					{
+						kept->Reload(*update);
+						kept->SetHotkey(update->GetHotKey());
+						result = kept;
+					}
+					existing.erase(match);
 				}
 
-				// check for break condition
-				if (it == _menuItems.end())
+				if (result == item)
 				{
-					break;
+					// adopted nodes take settings of this one
+					if (auto node = std::dynamic_pointer_cast<MenuNode>(item))
+					{
+						node->SetMaxVisibleMenuItems(_maxVisibleItems);
+						node->SetItemStyles(_itemStyles);
+					}
 				}
+				else
+				{
+					adopted.emplace(item.get(), result);
+				}
+
+				next.items.emplace_back(result);
 			}
 
-			//resolve zero selection issue
-			if (it->get()->IsSelected())
+			// keys outside of key space of this node are dropped
+			next.allocator = GetAllocator(_hkpolicy);
+			for (auto&& hotkey : incoming->hotkeys)
 			{
-				if (isAnySelected)
-					it->get()->Release();
-				else
-					isAnySelected = true;
+				auto item = hotkey.second.lock();
+				if (!item || !next.allocator.Take(hotkey.first))
+					continue;
+
+				auto replacement = adopted.find(item.get());
+				next.hotkeys.emplace(hotkey.first, replacement != adopted.end() ? replacement->second : item);
 			}
 
-		}
-		// resolve multiple selection conflicts
-		if (!isAnySelected && !_menuItems.empty())
-			_menuItems.begin()->get()->Select();
+			// selection stays on the same item or on the same position
+			auto target = std::find_if(next.items.begin(), next.items.end(), [&](auto&& item) { return !selectedId.empty() && item->GetStableId() == selectedId; });
+			if (target == next.items.end() && !next.items.empty())
+				target = next.items.begin() + std::min(selectedPosition, next.items.size() - 1);
 
-		auto fromIt = _menuItems.begin();
-		auto toIt = _menuItems.end();
+			// the new selection is set first, readers never see none
+			if (target != next.items.end())
+				target->get()->Select();
+			for (auto it = next.items.begin(); it != next.items.end(); ++it)
+			{
+				if (it != target)
+					it->get()->Release();
+			}
 
-		if (_maxVisibleItems < _menuItems.size())
-		{
-			fromIt = GetSelectedMenuIterator();
-			toIt = std::next(fromIt);
+			changed = next.items != state.items || next.hotkeyOffset != state.hotkeyOffset;
 
-			auto usedCount = 1u;
-			auto directionUp = true;
-			while (!(usedCount == _maxVisibleItems || usedCount == _menuItems.size()))
+			// kept nodes update their own paths, removed items leave paths before new ones take them
+			if (_index && changed)
 			{
-				// choose direction
-				if (directionUp)
+				std::unordered_set<const MenuItem*> kept;
+				for (auto&& item : next.items)
+					kept.insert(item.get());
+
+				std::unordered_set<const MenuItem*> old;
+				for (auto&& item : state.items)
 				{
-					// up
-					if (fromIt != _menuItems.begin())
-					{
-						fromIt = std::prev(fromIt);
-						++usedCount;
-					}
+					old.insert(item.get());
+					if (kept.find(item.get()) == kept.end())
+						Detach(item);
 				}
-				else
+
+				for (auto&& item : next.items)
 				{
-					//down
-					if (toIt != _menuItems.end())
-					{
-						toIt = std::next(toIt);
-						++usedCount;
-					}
+					if (old.find(item.get()) == old.end())
+						Attach(item);
 				}
-				directionUp = !directionUp;
 			}
-		}
 
+			state = std::move(next);
+		});
+
+		// menu on screen is repainted, rows which are the same are skipped
+		if (changed && _isProcessing)
+			Draw(false);
+	}
+
+	std::future<void> MenuNode::ReloadAsync(std::function<std::shared_ptr<MenuNode>()> builder)
+	{
+		auto done = std::make_shared<std::promise<void>>();
+		auto future = done->get_future();
+
+		uint64_t generation = 0u;
 		{
-			std::lock_guard<std::mutex> lk(global_set_pos_mutex);
+			std::lock_guard<std::mutex> lk(_reloadTarget->mutex);
+			generation = ++_reloadTarget->requested;
+		}
 
-			COORD coord = { 0, 0 };
+		// thread keeps target instead of node, node can be destroyed meanwhile
+		auto target = _reloadTarget;
+		std::thread([target, builder, done, generation]()
+		{
+			try
+			{
+				auto tree = builder ? builder() : nullptr;
 
-			// If the function fails, the return value is zero.
-			if (SetConsoleCursorPosition(_hOutput, coord) == 0)
+				// tree built by older call is dropped if newer one was reloaded first
+				std::lock_guard<std::mutex> lk(target->mutex);
+				if (tree && target->node && generation > target->reloaded)
+				{
+					target->reloaded = generation;
+					target->node->Reload(*tree);
+				}
+			}
+			catch (...)
 			{
-				auto ret = GetLastError();
-				assert(false);
+				done->set_exception(std::current_exception());
+				return;
 			}
+			done->set_value();
+		}).detach();
 
-			for (auto it = fromIt; it != toIt; ++it)
-				PrintMenuItem(*it);
-		}
+		return future;
+	}
 
-		// draw frame
-		for (auto&& _menuFrame : _menuFrames)
+	void MenuNode::EnableIndex()
+	{
+		std::lock_guard<std::recursive_mutex> lk(_writeMutex);
+
+		if (!_index)
+			SetIndex(std::make_shared<PathIndex>(), PathIndex::EscapeCaption(GetCaption()));
+	}
+
+	std::shared_ptr<MenuItem> MenuNode::FindPath(const tstring& path)
+	{
+		tstring root;
+		auto index = GetIndex(root);
+		if (!index || path.length() <= root.length() || path.compare(0, root.length(), root) != 0 || path[root.length()] != PathIndex::Separator)
+			return nullptr;
+
+		auto item = index->Find(path);
+		if (!item)
 		{
-			if (_menuFrame->IsVisible())
+			// nodes made on demand create children segment by segment
+			std::shared_ptr<MenuItem> node;
+			auto end = root.length();
+			while (end != tstring::npos)
 			{
-				_menuFrame->Update();
+				auto next = PathIndex::FindSeparator(path, end + 1);
+				auto prefix = path.substr(0, next);
+
+				item = index->Find(prefix);
+				if (!item)
+				{
+					auto parent = node ? std::dynamic_pointer_cast<MenuNode>(node) : nullptr;
+					if (node && !parent)
+						return nullptr;
+
+					(parent ? parent.get() : this)->Expand();
+					item = index->Find(prefix);
+					if (!item)
+						return nullptr;
+				}
+
+				node = item;
+				end = next;
 			}
 		}
+
+		return item->Deleted() ? nullptr : item;
 	}
 
-	void MenuNode::Clear() const
+	std::vector<std::pair<tstring, std::shared_ptr<MenuItem>>> MenuNode::EnumeratePaths(const tstring& prefix)
 	{
-		std::lock_guard<std::mutex> lk(global_set_pos_mutex);
+		std::vector<std::pair<tstring, std::shared_ptr<MenuItem>>> paths;
+
+		tstring root;
+		auto index = GetIndex(root);
+		if (!index)
+			return paths;
 
+		// prefix of root caption matches the whole tree
+		auto split = tstring::npos;
+		for (auto next = PathIndex::FindSeparator(prefix, 0u); next != tstring::npos; next = PathIndex::FindSeparator(prefix, next + 1))
+			split = next;
 
-		COORD coord = { 0, 0 };
-		// If the function fails, the return value is zero.
-		if (SetConsoleCursorPosition(_hOutput, coord) == 0)
+		if (split == tstring::npos)
 		{
-			auto ret = GetLastError();
-			assert(false);
+			if (root.compare(0, prefix.length(), prefix) == 0)
+				CollectPaths(root, paths);
+			return paths;
 		}
 
-		CONSOLE_SCREEN_BUFFER_INFO csbi;
-		GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
+		// children of parent starting with the last segment
+		auto parentPath = prefix.substr(0, split);
+		auto partial = prefix.substr(split + 1);
 
-		for (auto i = 0u; i < _maxVisibleItems; ++i)
-			_outstream << std::setfill(_T(' ')) << std::setw(csbi.dwSize.X - 1) << _T(" ") << std::endl;
-	}
+		std::shared_ptr<MenuNode> holder;
+		auto parent = this;
+		if (parentPath != root)
+		{
+			holder = std::dynamic_pointer_cast<MenuNode>(FindPath(parentPath));
+			parent = holder.get();
+		}
+		if (parent == nullptr)
+			return paths;
 
-	void MenuNode::ProcessHotKey(int32_t code)
-	{
-		if (IsHotKeyInUse(code))
+		auto snapshot = parent->GetSnapshot();
+		for (auto&& item : snapshot->items)
 		{
-			auto activeIter = GetSelectedMenuIterator();
-			auto iter = activeIter->get();
+			if (item->Deleted())
+				continue;
 
-			if (iter->IsVisible())
-			{
-				iter->Release();
-				_hotkeys.at(code).lock()->Select();
+			auto caption = PathIndex::EscapeCaption(item->GetCaption());
+			if (caption.compare(0, partial.length(), partial) != 0)
+				continue;
 
-				Draw();
-			}
+			auto path = parentPath + PathIndex::Separator + caption;
+			paths.emplace_back(path, item);
+
+			if (auto node = std::dynamic_pointer_cast<MenuNode>(item))
+				node->CollectPaths(path, paths);
 		}
+		return paths;
 	}
 
-	void MenuNode::PrintMenuItem(const std::shared_ptr<MenuItem>& item) const
+	bool MenuNode::ExecuteAt(const tstring& path)
 	{
-		_outstream << std::setfill(_T(' ')) << std::left;
-		if (item->IsVisible())
+		tstring root;
+		auto index = GetIndex(root);
+		if (!index)
+			return false;
+
+		if (path != root)
 		{
-			_outstream << (item->IsSelected() ? _T("->") : _T("  ")) << std::setw(_hotkeyOffset + 3) << item->GetCaption();
-			auto hotkey = item->GetHotKey();
-			if (hotkey)
+			if (!FindPath(path))
+				return false;
+
+			// every node on path enters the next one, nothing is set if path is removed meanwhile
+			std::vector<std::shared_ptr<MenuItem>> items;
+			auto end = root.length();
+			while (end != tstring::npos)
 			{
-				_outstream << _T("[");
-				switch (_hkpolicy)
-				{
-				case HotkeyPolicy::hp_letters: _outstream << TCHAR(hotkey); break;
-				case HotkeyPolicy::hp_fx_keys: _outstream << _T("F");
-				case HotkeyPolicy::hp_numbers: _outstream << (hotkey - 1); break;
-				default: break;
-				}
+				auto next = PathIndex::FindSeparator(path, end + 1);
+				auto item = index->Find(path.substr(0, next));
+				if (!item)
+					return false;
 
-				_outstream << _T("]  ");
+				items.emplace_back(item);
+				end = next;
 			}
-			// show message
-			if (item->IsMessageVisible())
-				_outstream << item->GetMessage();
 
-			// new ine and synchronization
-			_outstream << std::endl;
+			MenuNode* node = this;
+			for (size_t i = 0u; i < items.size() && node; ++i)
+			{
+				std::atomic_store(&node->_entering, items[i]);
+				node = dynamic_cast<MenuNode*>(items[i].get());
+			}
 		}
+
+		Execute();
+		return true;
 	}
 
-	void MenuNode::OnBack()
+	std::shared_ptr<PathIndex> MenuNode::GetIndex(tstring& path)
 	{
-		_isProcessing = false;
+		std::lock_guard<std::recursive_mutex> lk(_writeMutex);
+
+		path = _path;
+		return _index;
 	}
 
-	void MenuNode::OnEnter()
+	void MenuNode::SetIndex(std::shared_ptr<PathIndex> index, const tstring& path)
 	{
-		auto it = GetSelectedMenuIterator();
-		if (it != _menuItems.end())
-		{
-			it->get()->RunCallback();
+		std::lock_guard<std::recursive_mutex> lk(_writeMutex);
 
-			it = GetSelectedMenuIterator();
-			if (it != _menuItems.end())
-				it->get()->Execute();
-			else
-			{
-				OnBack();
-				return;
-			}
-		}
-		Draw();
+		_index = index;
+		_path = path;
+
+		// items of open batch are not published yet
+		auto snapshot = GetSnapshot();
+		for (auto&& item : _pending ? _pending->items : snapshot->items)
+			Attach(item);
 	}
 
-	void MenuNode::ProcessKey()
+	void MenuNode::Attach(const std::shared_ptr<MenuItem>& item)
 	{
-		while (_isProcessing)
-		{
-			auto ch = GetKey();
-			if (ch == 0 || ch == 224)
-			{
-				// due to guidlines need to call this function twice
-				// depends on implementation of getch analogs
-				ch = GetKey();
-				switch (ch)
-				{
-				case 75:
-					/* left arrow handling */
-					OnBack();
-					break;
-				case 77:
-					/* right arrow handling */
-					OnEnter();
-					break;
-				case 72:
-					/* up arrow handling */
-					SetPreviousSelected();
+		auto path = _path + PathIndex::Separator + PathIndex::EscapeCaption(item->GetCaption());
+		_index->Add(path, item);
 
-					Draw();
-					break;
-				case 80:
-					/* down arrow handling */
-					SetNextSelected();
-					Draw();
-					break;
-				default:
-				{
-					if (_hkpolicy == HotkeyPolicy::hp_fx_keys)
-					{
-						//f1 = f12
-						if (ch >= 59 && ch <= 68 || ch == 133 || ch == 134)
-							ProcessHotKey(ch);
-					}
-				}
-				}
-			}
-			else
-			{
-				// ENTER
-				if (ch == 13)
-				{
-					OnEnter();
-					continue;
-				}
+		if (auto node = std::dynamic_pointer_cast<MenuNode>(item))
+			node->SetIndex(_index, path);
+	}
 
-				// ESCAPE or BACKSPACE
-				if (ch == 27 || ch == 8)
-				{
-					OnBack();
-					continue;
-				}
+	void MenuNode::Detach(const std::shared_ptr<MenuItem>& item)
+	{
+		_index->Remove(_path + PathIndex::Separator + PathIndex::EscapeCaption(item->GetCaption()), item.get());
 
-				// HOTKEYS
-				auto key = ch;
+		if (auto node = std::dynamic_pointer_cast<MenuNode>(item))
+		{
+			std::lock_guard<std::recursive_mutex> lk(node->_writeMutex);
 
-				switch (_hkpolicy)
-				{
-				case HotkeyPolicy::hp_letters:
-				{
-					key = toupper(ch);
-					break;
-				}
-				case HotkeyPolicy::hp_numbers:
-				{
-					key = ch - _T('0');
-					break;
-				}
-				default: continue;
-				}
-				ProcessHotKey(key);
-			}
+			auto snapshot = node->GetSnapshot();
+			for (auto&& child : node->_pending ? node->_pending->items : snapshot->items)
+				node->Detach(child);
+
+			node->_index.reset();
+			node->_path.clear();
 		}
 	}
 
-	void MenuNode::SetNextSelected()
+	void MenuNode::CollectPaths(const tstring& path, std::vector<std::pair<tstring, std::shared_ptr<MenuItem>>>& paths)
 	{
-		auto activeIter = GetSelectedMenuIterator();
-		if (activeIter != _menuItems.end())
+		auto snapshot = GetSnapshot();
+		for (auto&& item : snapshot->items)
 		{
-			activeIter->get()->Release();
-			if (++activeIter == _menuItems.end())
-				SetFirtsSelected();
-			else
-				activeIter->get()->Select();
+			if (item->Deleted())
+				continue;
+
+			auto child = path + PathIndex::Separator + PathIndex::EscapeCaption(item->GetCaption());
+			paths.emplace_back(child, item);
+
+			if (auto node = std::dynamic_pointer_cast<MenuNode>(item))
+				node->CollectPaths(child, paths);
 		}
 	}
 
-	void MenuNode::SetPreviousSelected()
+	bool MenuNode::PurgeDeleted()
 	{
-		auto activeIter = GetSelectedMenuIterator();
-		if (activeIter != _menuItems.end())
+		auto removed = false;
+		Mutate([&](Snapshot& state)
 		{
-			activeIter->get()->Release();
-			if (activeIter == _menuItems.begin())
-				SetLastSelected();
-			else
-				(--activeIter)->get()->Select();
+			auto& items = state.items;
+			auto selected = GetSelectedMenuIterator(items);
+
+			// selection moves to the next item which stays
+			if (selected != items.end() && selected->get()->Deleted())
+			{
+				selected->get()->Release();
+				auto next = std::find_if(selected, items.cend(), [](auto&& item) { return !item->Deleted(); });
+				if (next == items.end())
+					next = std::find_if(items.cbegin(), items.cend(), [](auto&& item) { return !item->Deleted(); });
+				if (next != items.end())
+					next->get()->Select();
+			}
+
+			if (_index)
+			{
+				for (auto&& item : items)
+				{
+					if (item->Deleted())
+						Detach(item);
+				}
+			}
+
+			Items kept;
+			for (auto&& item : items)
+			{
+				if (!item->Deleted())
+					kept.emplace_back(item);
+			}
+			removed = kept.size() != items.size();
+			items = std::move(kept);
+
+			// other items keep their keys
+			if (removed)
+				ReleaseHotkeys(state);
+		});
+		return removed;
+	}
+
+	void MenuNode::Draw(bool draw_frames)
+	{
+		TraceSpan span("MenuNode::Draw", "render");
+		MeteredLock lc(_drawMutex, Metrics::DrawLock);
+		Metrics::Add(Metric::m_repaints);
+
+		// console was resized while other node was processing keys
+		if (_layout && (_layoutGeneration != ConsoleGeometry::GetGeneration() || _layout->IsDirty()))
+			Relayout();
+
+		// items drawn are kept alive while writers publish new ones
+		auto snapshot = GetSnapshot();
+
+		// items marked as deleted are removed by publishing new snapshot, items are searched only after some item was deleted
+		auto deletions = MenuItem::GetDeletions();
+		if (deletions != _purgedDeletions)
+		{
+			_purgedDeletions = deletions;
+			if (PurgeDeleted())
+				snapshot = GetSnapshot();
+		}
+
+		auto& items = snapshot->items;
+
+		// on empty
+		if (items.empty())
+		{
+			OnBack();
+			return;
+		}
+
+		// resolve zero selection issue and multiple selection conflicts
+		auto selected = ResolveSelected(items);
+		if (selected == items.size())
+		{
+			selected = 0u;
+			SelectAt(items, selected);
+		}
+
+		// selected item is the most likely to be entered next
+		items[selected]->Prefetch();
+
+		// window is computed from selected position, cost does not depend on count of items
+		auto fromIt = items.begin() + GetWindowFirst(selected, items.size());
+		auto toIt = fromIt + std::min(_maxVisibleItems, items.size());
+
+		auto size = ConsoleGeometry::GetSize();
+
+		std::vector<StyledText> rows;
+		std::vector<size_t> widths;
+		for (auto it = fromIt; it != toIt; ++it)
+		{
+			if (it->get()->IsVisible())
+			{
+				size_t width = 0u;
+				rows.emplace_back(FormatMenuItem(*it, snapshot->hotkeyOffset, width));
+				widths.emplace_back(width);
+			}
+		}
+
+		// rows are padded to console width to overwrite previous ones
+		size_t lineWidth = size.X > 1 ? size.X - 1 : 0;
+		rows.resize(std::max(rows.size(), _maxVisibleItems));
+		widths.resize(rows.size());
+		for (size_t i = 0u; i < rows.size(); ++i)
+		{
+			if (widths[i] < lineWidth)
+				rows[i].Append(tstring(lineWidth - widths[i], _T(' ')));
+		}
+
+		{
+			MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+
+			// menu rows and prompt
+			Compositor::Instance().SetRect(this, SMALL_RECT{ 0, 0, static_cast<SHORT>(size.X - 1), static_cast<SHORT>(_maxVisibleItems) }, true);
+
+			// rows which did not change are not printed again
+			_rows.swap(rows);
+			PrintRows(&rows);
+		}
+
+		if (!draw_frames)
+			return;
+
+		// draw frame
+		for (auto&& _menuFrame : _menuFrames)
+		{
+			if (_menuFrame->IsVisible())
+			{
+				_menuFrame->Update();
+			}
+		}
+	}
+
+	void MenuNode::Clear() const
+	{
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+
+		auto size = ConsoleGeometry::GetSize();
+		tstring blank(size.X > 1 ? size.X - 1 : 0, _T(' '));
+
+		for (auto i = 0u; i < _maxVisibleItems; ++i)
+			Compositor::Instance().Write(this, _hOutput, _outstream, COORD{ 0, static_cast<SHORT>(i) }, blank);
+		Compositor::Instance().Present(_hOutput, _outstream);
+		_rows.clear();
+		_outstream.flush();
+	}
+
+	void MenuNode::PrintRows(const std::vector<StyledText>* drawn) const
+	{
+		auto& compositor = Compositor::Instance();
+
+		for (size_t i = 0u; i < _rows.size(); ++i)
+		{
+			if (drawn == nullptr || i >= drawn->size() || (*drawn)[i] != _rows[i])
+				compositor.Write(this, _hOutput, _outstream, COORD{ 0, static_cast<SHORT>(i) }, _rows[i]);
+		}
+
+		if (!_prompt.empty() && drawn == nullptr)
+			compositor.Write(this, _hOutput, _outstream, COORD{ 0, static_cast<SHORT>(_maxVisibleItems) }, _prompt);
+
+		compositor.Present(_hOutput, _outstream);
+		_outstream.flush();
+	}
+
+	void MenuNode::Recompose()
+	{
+		PrintRows();
+	}
+
+	void MenuNode::ProcessHotKey(int32_t code)
+	{
+		auto snapshot = GetSnapshot();
+		auto hotkey = snapshot->hotkeys.find(code);
+		if (hotkey == snapshot->hotkeys.end())
+			return;
+
+		// item may be removed by other thread
+		auto item = hotkey->second.lock();
+		auto selected = ResolveSelected(snapshot->items);
+		if (item && selected != snapshot->items.size() && snapshot->items[selected]->IsVisible())
+		{
+			// position of item is found by the next draw
+			snapshot->items[selected]->Release();
+			item->Select();
+
+			Draw();
+		}
+	}
+
+	StyledText MenuNode::FormatMenuItem(const std::shared_ptr<MenuItem>& item, size_t hotkeyOffset, size_t& width) const
+	{
+		// pad by columns, wide characters take more than one
+		StyledText row;
+		if (item->IsSelected())
+			row.Append(_T("->") + item->GetCaption(), _itemStyles.selected);
+		else
+			row.Append(_T("  ") + item->GetCaption());
+		row.Append(tstring(hotkeyOffset + 3 - item->GetCaptionLength(), _T(' ')));
+		width = hotkeyOffset + 5;
+
+		auto hotkey = item->GetHotKey();
+		if (hotkey)
+		{
+			tstring tag = _T("[");
+			switch (_hkpolicy)
+			{
+			case HotkeyPolicy::hp_letters: tag += TCHAR(hotkey); break;
+			case HotkeyPolicy::hp_fx_keys: tag += _T("F");
+			case HotkeyPolicy::hp_numbers: tag += Text::Number(hotkey - 1); break;
+			default: break;
+			}
+			tag += _T("]");
+
+			// tag is ascii
+			row.Append(tag, _itemStyles.hotkey).Append(_T("  "));
+			width += tag.length() + 2;
+		}
+		// show message
+		if (item->IsMessageVisible())
+		{
+			auto success = item->GetCallbackResult();
+			auto& style = success ? _itemStyles.success : _itemStyles.error;
+			row.Append(item->GetMessage(), style);
+			width += item->GetMessageWidth(success);
+		}
+
+		return row;
+	}
+
+	void MenuNode::OnBack()
+	{
+		_isProcessing = false;
+	}
+
+	void MenuNode::OnEnter()
+	{
+		auto snapshot = GetSnapshot();
+		auto selected = ResolveSelected(snapshot->items);
+		if (selected != snapshot->items.size())
+		{
+			// callback may change items, they are read again
+			snapshot->items[selected]->RunCallback();
+
+			snapshot = GetSnapshot();
+			selected = ResolveSelected(snapshot->items);
+			if (selected != snapshot->items.size())
+				snapshot->items[selected]->Execute();
+			else
+			{
+				OnBack();
+				return;
+			}
+		}
+		Draw();
+	}
+
+	void MenuNode::ProcessKey()
+	{
+		while (_isProcessing)
+		{
+			auto ch = GetKey();
+			if (ch == ResizeKey)
+			{
+				OnResize();
+				continue;
+			}
+
+			if (ch == 0 || ch == 224)
+			{
+				// due to guidlines need to call this function twice
+				// depends on implementation of getch analogs
+				ch = GetKey();
+				switch (ch)
+				{
+				case 75:
+					/* left arrow handling */
+					OnBack();
+					break;
+				case 77:
+					/* right arrow handling */
+					OnEnter();
+					break;
+				case 72:
+					/* up arrow handling */
+					SetPreviousSelected();
+
+					Draw();
+					break;
+				case 80:
+					/* down arrow handling */
+					SetNextSelected();
+					Draw();
+					break;
+				case 73:
+					/* page up moves selection by window of items */
+					MoveSelected(-ptrdiff_t(_maxVisibleItems));
+					Draw();
+					break;
+				case 81:
+					/* page down */
+					MoveSelected(ptrdiff_t(_maxVisibleItems));
+					Draw();
+					break;
+				case 71:
+					/* home */
+					SetFirtsSelected();
+					Draw();
+					break;
+				case 79:
+					/* end */
+					SetLastSelected();
+					Draw();
+					break;
+				case 132:
+					/* ctrl + page up scrolls active frame */
+					if (auto frame = GetActiveFrame())
+						frame->PageUp();
+					break;
+				case 118:
+					/* ctrl + page down */
+					if (auto frame = GetActiveFrame())
+						frame->PageDown();
+					break;
+				case 119:
+					/* ctrl + home */
+					if (auto frame = GetActiveFrame())
+						frame->ScrollHome();
+					break;
+				case 117:
+					/* ctrl + end returns to the tail */
+					if (auto frame = GetActiveFrame())
+						frame->ScrollEnd();
+					break;
+				default:
+				{
+					if (auto frame = GetActiveFrame())
+					{
+						if (frame->HandleKey(ch, true))
+							break;
+					}
+
+					if (_hkpolicy == HotkeyPolicy::hp_fx_keys)
+					{
+						//f1 = f12
+						if (ch >= 59 && ch <= 68 || ch == 133 || ch == 134)
+							ProcessHotKey(ch);
+					}
+				}
+				}
+			}
+			else
+			{
+				// ENTER
+				if (ch == 13)
+				{
+					OnEnter();
+					continue;
+				}
+
+				// ESCAPE or BACKSPACE
+				if (ch == 27 || ch == 8)
+				{
+					OnBack();
+					continue;
+				}
+
+				// SEARCH in frames
+				if (ch == _T('/'))
+				{
+					Search();
+					continue;
+				}
+
+				// JUMP to item by its number
+				if (ch == _T(':'))
+				{
+					JumpToIndex();
+					continue;
+				}
+
+				// TAB switches frame scrolled by keys
+				if (ch == 9)
+				{
+					SetNextActiveFrame();
+					continue;
+				}
+
+				// CTRL+G shows or hides metrics of UI
+				if (ch == 7)
+				{
+					ToggleMetrics();
+					continue;
+				}
+
+				// CTRL+T toggles following tail of active frame
+				if (ch == 20)
+				{
+					if (auto frame = GetActiveFrame())
+						frame->SetFollowTail(!frame->IsFollowingTail());
+					continue;
+				}
+
+				// keys of active frame
+				if (auto frame = GetActiveFrame())
+				{
+					if (frame->HandleKey(ch, false))
+						continue;
+				}
+
+				// HOTKEYS
+				auto key = ch;
+
+				switch (_hkpolicy)
+				{
+				case HotkeyPolicy::hp_letters:
+				{
+					key = toupper(ch);
+					break;
+				}
+				case HotkeyPolicy::hp_numbers:
+				{
+					key = ch - _T('0');
+					break;
+				}
+				default: continue;
+				}
+				ProcessHotKey(key);
+			}
+		}
+	}
+
+	void MenuNode::JumpToIndex()
+	{
+		tstring number;
+
+		while (true)
+		{
+			PrintPrompt(_T(":") + number);
+
+			auto ch = GetKey();
+			if (ch == ResizeKey)
+			{
+				OnResize();
+				continue;
+			}
+
+			if (ch == 0 || ch == 224)
+			{
+				// ignore arrows and functional keys
+				GetKey();
+				continue;
+			}
+
+			// ENTER
+			if (ch == 13)
+				break;
+
+			// ESCAPE
+			if (ch == 27)
+			{
+				PrintPrompt(_T(""));
+				return;
+			}
+
+			// BACKSPACE
+			if (ch == 8)
+			{
+				if (!number.empty())
+					number.pop_back();
+				continue;
+			}
+
+			if (ch >= _T('0') && ch <= _T('9') && number.length() < 18)
+				number.push_back(static_cast<TCHAR>(ch));
+		}
+
+		PrintPrompt(_T(""));
+
+		// items are numbered from 1, numbers past the last item select it
+		size_t position = 0u;
+		for (auto digit : number)
+			position = position * 10 + (digit - _T('0'));
+
+		auto snapshot = GetSnapshot();
+		auto& items = snapshot->items;
+		if (position == 0 || items.empty())
+			return;
+
+		SelectAt(items, std::min(position, items.size()) - 1);
+		Draw();
+	}
+
+	void MenuNode::Search()
+	{
+		tstring query;
+
+		while (true)
+		{
+			PrintPrompt(_T("/") + query);
+
+			auto ch = GetKey();
+			if (ch == ResizeKey)
+			{
+				OnResize();
+				continue;
+			}
+
+			if (ch == 0 || ch == 224)
+			{
+				// ignore arrows and functional keys
+				GetKey();
+				continue;
+			}
+
+			// ENTER
+			if (ch == 13)
+				break;
+
+			// ESCAPE cancels search and returns frames to their tails
+			if (ch == 27)
+			{
+				PrintPrompt(_T(""));
+				for (auto&& frame : _menuFrames)
+					frame->FollowTail();
+				return;
+			}
+
+			// BACKSPACE
+			if (ch == 8)
+			{
+				if (!query.empty())
+					query.pop_back();
+				continue;
+			}
+
+			query.push_back(static_cast<TCHAR>(ch));
+		}
+
+		// empty query repeats the last one
+		if (query.empty())
+			query = _lastQuery;
+		else
+			_lastQuery = query;
+
+		auto found = false;
+		for (auto&& frame : _menuFrames)
+		{
+			if (frame->IsVisible())
+				found = frame->FindNext(query) || found;
+		}
+
+		PrintPrompt(found ? _T("") : _T("Not found: ") + query);
+	}
+
+	std::shared_ptr<MenuFrame> MenuNode::GetActiveFrame() const
+	{
+		if (_activeFrame < _menuFrames.size() && _menuFrames[_activeFrame]->IsVisible())
+			return _menuFrames[_activeFrame];
+		return nullptr;
+	}
+
+	void MenuNode::SetLayout(std::shared_ptr<Layout> layout)
+	{
+		_layout = layout;
+		if (!_layout)
+			return;
+
+		for (auto&& frame : _layout->GetFrames())
+		{
+			if (std::find(_menuFrames.begin(), _menuFrames.end(), frame) == _menuFrames.end())
+				AddFrame(frame);
+		}
+	}
+
+	std::vector<std::shared_ptr<MenuFrame>> MenuNode::Relayout()
+	{
+		_layoutGeneration = ConsoleGeometry::GetGeneration();
+
+		if (!_layout)
+			return {};
+
+		// menu items and prompt take the top rows
+		auto size = ConsoleGeometry::GetSize();
+		SMALL_RECT area = { 0, static_cast<SHORT>(_maxVisibleItems + 1), static_cast<SHORT>(size.X - 1), static_cast<SHORT>(size.Y - 1) };
+
+		return _layout->Arrange(area);
+	}
+
+	void MenuNode::OnResize()
+	{
+		auto width = ConsoleGeometry::GetSize().X;
+		if (!ConsoleGeometry::Refresh())
+			return;
+
+		// old areas of moved frames are cleared before anything is drawn
+		auto moved = Relayout();
+
+		// menu rows are padded to console width
+		if (ConsoleGeometry::GetSize().X != width)
+			Draw(false);
+
+		for (auto&& frame : moved)
+		{
+			if (frame->IsVisible())
+				frame->Update();
+		}
+	}
+
+	void MenuNode::ToggleMetrics()
+	{
+		if (!_metricsFrame)
+		{
+			_metricsFrame = std::make_shared<MetricsFrame>();
+			_metricsFrame->Hide();
+			_metricsFrame->SetConsole(_hOutput);
+		}
+
+		if (_metricsFrame->IsVisible())
+		{
+			_metricsFrame->StopPolling();
+			_metricsFrame->Hide();
+			return;
+		}
+
+		// top right corner above menu and frames
+		const short width = 44;
+		auto size = ConsoleGeometry::GetSize();
+		_metricsFrame->SetGeometry(size.X > width ? size.X - width : 0, 0, width, static_cast<short>(MetricsFrame::GetRowCount() + 2));
+		_metricsFrame->BringToFront();
+		_metricsFrame->Show();
+		_metricsFrame->StartPolling(std::chrono::milliseconds(500));
+	}
+
+	void MenuNode::SetNextActiveFrame()
+	{
+		for (size_t i = 1u; i <= _menuFrames.size(); ++i)
+		{
+			auto next = (_activeFrame + i) % _menuFrames.size();
+			if (_menuFrames[next]->IsVisible())
+			{
+				_activeFrame = next;
+				return;
+			}
+		}
+	}
+
+	void MenuNode::PrintPrompt(const tstring& text) const
+	{
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+
+		auto size = ConsoleGeometry::GetSize();
+
+		auto width = Text::Width(text);
+		size_t lineWidth = size.X > 1 ? size.X - 1 : 0;
+		_prompt = text + tstring(width < lineWidth ? lineWidth - width : 0u, _T(' '));
+
+		auto& compositor = Compositor::Instance();
+		compositor.Write(this, _hOutput, _outstream, COORD{ 0, static_cast<SHORT>(_maxVisibleItems) }, _prompt);
+		compositor.Present(_hOutput, _outstream);
+		_outstream.flush();
+	}
+
+	void MenuNode::SetNextSelected()
+	{
+		auto snapshot = GetSnapshot();
+		auto& items = snapshot->items;
+
+		auto selected = ResolveSelected(items);
+		if (selected != items.size())
+			SelectAt(items, selected + 1 == items.size() ? 0u : selected + 1);
+	}
+
+	void MenuNode::SetPreviousSelected()
+	{
+		auto snapshot = GetSnapshot();
+		auto& items = snapshot->items;
+
+		auto selected = ResolveSelected(items);
+		if (selected != items.size())
+			SelectAt(items, selected == 0 ? items.size() - 1 : selected - 1);
+	}
+
+	void MenuNode::MoveSelected(ptrdiff_t count)
+	{
+		auto snapshot = GetSnapshot();
+		auto& items = snapshot->items;
+
+		auto selected = ResolveSelected(items);
+		if (selected == items.size())
+			return;
+
+		auto last = ptrdiff_t(items.size()) - 1;
+		auto position = std::min(std::max(ptrdiff_t(selected) + count, ptrdiff_t(0)), last);
+		SelectAt(items, size_t(position));
+	}
+
+	void MenuNode::ResetSelected()
+	{
+		auto snapshot = GetSnapshot();
+		for (auto &&item : snapshot->items)
+			item->Release();
+		if (!snapshot->items.empty())
+			snapshot->items.front()->Select();
+		_selectedHint = 0u;
+	}
+
+	void MenuNode::SetFirtsSelected()
+	{
+		auto snapshot = GetSnapshot();
+		if (!snapshot->items.empty())
+			SelectAt(snapshot->items, 0u);
+	}
+
+	void MenuNode::SetLastSelected()
+	{
+		auto snapshot = GetSnapshot();
+		if (!snapshot->items.empty())
+			SelectAt(snapshot->items, snapshot->items.size() - 1);
+	}
+
+	MenuNode::Items::const_iterator MenuNode::GetSelectedMenuIterator(const Items& items)
+	{
+		return std::find_if(items.begin(), items.end(), [](auto&& item) { return item->IsSelected(); });
+	}
+
+	size_t MenuNode::ResolveSelected(const Items& items)
+	{
+		// no item was selected since the selected one was the only one, hint is valid if it points to it
+		auto selections = MenuItem::GetSelections();
+		auto hint = _selectedHint.load();
+		if (selections == _selectionsSeen && hint < items.size() && items[hint]->IsSelected())
+			return hint;
+
+		// selection was changed directly, e.g. by reload, or items were replaced
+		auto selected = items.size();
+		for (size_t i = 0u; i < items.size(); ++i)
+		{
+			if (!items[i]->IsSelected())
+				continue;
+
+			if (selected == items.size())
+				selected = i;
+			else
+				items[i]->Release();
+		}
+
+		if (selected != items.size())
+			_selectedHint = selected;
+		_selectionsSeen = selections;
+		return selected;
+	}
+
+	void MenuNode::SelectAt(const Items& items, size_t position)
+	{
+		auto selected = ResolveSelected(items);
+		if (selected == position)
+			return;
+
+		// the new selection is set first, readers never see none
+		auto selections = MenuItem::GetSelections();
+		items[position]->Select();
+		if (selected != items.size())
+			items[selected]->Release();
+		_selectedHint = position;
+
+		// item selected by other thread meanwhile is released by the next search
+		if (MenuItem::GetSelections() == selections + 1)
+			_selectionsSeen = selections + 1;
+	}
+
+	size_t MenuNode::GetWindowFirst(size_t selected, size_t count) const
+	{
+		if (count <= _maxVisibleItems)
+			return 0u;
+
+		size_t above = 0u;
+		switch (_vsp)
+		{
+		case VisibleScrollPolicy::vsp_center: above = _maxVisibleItems / 2; break;
+		case VisibleScrollPolicy::vsp_down: above = 0u; break;
+		case VisibleScrollPolicy::vsp_up: above = _maxVisibleItems - 1; break;
+		default: break;
+		}
+
+		// window does not go past the first and the last item
+		auto first = selected > above ? selected - above : 0u;
+		return std::min(first, count - _maxVisibleItems);
+	}
+
+	void MenuItem::Connect(std::function<bool()> callback)
+	{
+		_callback = callback;
+	}
+
+	void MenuNode::AssignHotkey(Snapshot& state, const std::shared_ptr<MenuItem>& item)
+	{
+		size_t key = 0u;
+
+		switch (_hkpolicy)
+		{
+		case HotkeyPolicy::hp_letters:
+			// the first available character of caption
+			key = state.allocator.TakeFromCaption(item->GetCaption());
+			break;
+		case HotkeyPolicy::hp_numbers:
+		case HotkeyPolicy::hp_fx_keys:
+			// keys freed by removed items are reused
+			key = state.allocator.TakeLowest();
+			break;
+		default:
+			break;
+		}
+
+		if (key)
+		{
+			state.hotkeys[key] = item;
+			item->SetHotkey(GetHotkeyLabel(_hkpolicy, key));
+		}
+	}
+
+	void MenuNode::ReleaseHotkeys(Snapshot& state)
+	{
+		auto gone = [](const std::weak_ptr<MenuItem>& weak)
+		{
+			auto item = weak.lock();
+			return !item || item->Deleted();
+		};
+
+		for (auto it = state.hotkeys.begin(); it != state.hotkeys.end();)
+		{
+			if (gone(it->second))
+			{
+				state.allocator.Release(it->first);
+				it = state.hotkeys.erase(it);
+			}
+			else
+				++it;
+		}
+
+		for (auto&& parked : state.parked)
+		{
+			auto& hotkeys = parked.second;
+			for (auto it = hotkeys.begin(); it != hotkeys.end();)
+				it = gone(it->second) ? hotkeys.erase(it) : std::next(it);
+		}
+	}
+
+	HotkeyAllocator MenuNode::GetAllocator(HotkeyPolicy policy)
+	{
+		switch (policy)
+		{
+		case HotkeyPolicy::hp_letters: return HotkeyAllocator::Letters();
+		case HotkeyPolicy::hp_numbers: return HotkeyAllocator::Numbers();
+		case HotkeyPolicy::hp_fx_keys: return HotkeyAllocator::FxKeys();
+		default: return HotkeyAllocator();
+		}
+	}
+
+	size_t MenuNode::GetHotkeyCode(const MenuItem* item) const
+	{
+		auto state = GetSnapshot();
+		for (auto&& hotkey : state->hotkeys)
+		{
+			if (hotkey.second.lock().get() == item)
+				return hotkey.first;
+		}
+		return 0u;
+	}
+
+	size_t MenuNode::GetHotkeyLabel(HotkeyPolicy policy, size_t key)
+	{
+		switch (policy)
+		{
+		case HotkeyPolicy::hp_numbers: return key + 1u;
+		case HotkeyPolicy::hp_fx_keys: return (key < 133u ? key - 58u : key - 122u) + 1u;
+		default: return key;
+		}
+	}
+
+	std::shared_ptr<MenuItem> MenuNode::GetSelectedItem()
+	{
+		auto snapshot = GetSnapshot();
+		auto selected = ResolveSelected(snapshot->items);
+		return selected != snapshot->items.size() ? snapshot->items[selected] : nullptr;
+	}
+
+	void MenuNode::RemoveSelectedItem()
+	{
+		auto snapshot = GetSnapshot();
+		auto selected = ResolveSelected(snapshot->items);
+		if (selected != snapshot->items.size())
+			snapshot->items[selected]->Delete();
+	}
+
+	void MenuNode::AddFrame(std::shared_ptr<MenuFrame> frame)
+	{
+		frame->SetConsole(_hOutput);
+		_menuFrames.emplace_back(frame);
+	}
+
+	void MenuNode::Execute()
+	{
+		if (_hOutput == nullptr || GetSnapshot()->items.empty())
+		{
+			// deep link is not followed, nodes below do not enter it later
+			DropEntering();
+			return;
+		}
+
+		// menu of entered node is above everything drawn before
+		Compositor::Instance().Raise(this);
+
+		// rows on screen belong to other node now
+		{
+			MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+			_rows.clear();
+		}
+
+		Draw();
+		_isProcessing = true;
+
+		// deep link enters item as if it was chosen by keys
+		if (auto entering = std::atomic_exchange(&_entering, std::shared_ptr<MenuItem>()))
+		{
+			auto snapshot = GetSnapshot();
+			auto position = std::find(snapshot->items.begin(), snapshot->items.end(), entering);
+			if (position != snapshot->items.end())
+			{
+				SelectAt(snapshot->items, size_t(position - snapshot->items.begin()));
+				OnEnter();
+			}
+
+			// item entered by node below is dropped if it was not executed
+			if (auto node = dynamic_cast<MenuNode*>(entering.get()))
+				node->DropEntering();
+		}
+
+		ProcessKey();
+
+		if (_metricsFrame && _metricsFrame->IsVisible())
+			ToggleMetrics();
+
+		// parent node draws its rows again
+		Compositor::Instance().SetRect(this, SMALL_RECT{ 0, 0, -1, -1 }, false);
+	}
+
+	void MenuNode::DropEntering()
+	{
+		auto entering = std::atomic_exchange(&_entering, std::shared_ptr<MenuItem>());
+		while (auto node = dynamic_cast<MenuNode*>(entering.get()))
+			entering = std::atomic_exchange(&node->_entering, std::shared_ptr<MenuItem>());
+	}
+
+	void MenuNode::Reset()
+	{
+		Mutate([this](Snapshot& state)
+		{
+			if (_index)
+			{
+				for (auto&& item : state.items)
+					Detach(item);
+			}
+
+			state.items.clear();
+			state.hotkeys.clear();
+			state.allocator.Clear();
+			state.parked.clear();
+			state.hotkeyOffset = 0;
+		});
+	}
+
+	size_t MenuNode::GetSelectedPosition()
+	{
+		auto snapshot = GetSnapshot();
+		auto selected = ResolveSelected(snapshot->items);
+		return selected != snapshot->items.size() ? selected : 0u;
+	}
+
+	bool MenuNode::Empty() const
+	{
+		return GetSnapshot()->items.empty();
+	}
+
+	void MenuNode::SetPolicy(HotkeyPolicy policy)
+	{
+		// 
+		if (policy != _hkpolicy)
+		{
+			Mutate([&](Snapshot& state)
+			{
+				// keys of the previous policy are kept for switching back
+				state.parked[_hkpolicy] = std::move(state.hotkeys);
+				state.hotkeys.clear();
+
+				auto parked = state.parked.find(policy);
+				if (parked != state.parked.end())
+				{
+					state.hotkeys = std::move(parked->second);
+					state.parked.erase(parked);
+				}
+
+				_hkpolicy = policy;
+				state.allocator = GetAllocator(policy);
+
+				// items keep keys they had under this policy
+				for (auto&& item : state.items)
+					item->SetHotkey(0u);
+
+				ReleaseHotkeys(state);
+
+				std::unordered_set<const MenuItem*> assigned;
+				for (auto&& hotkey : state.hotkeys)
+				{
+					if (auto item = hotkey.second.lock())
+					{
+						state.allocator.Take(hotkey.first);
+						item->SetHotkey(GetHotkeyLabel(policy, hotkey.first));
+						assigned.insert(item.get());
+					}
+				}
+
+				// items added since then get free keys
+				for (auto&& item : state.items)
+				{
+					if (!item->Deleted() && assigned.find(item.get()) == assigned.end())
+						AssignHotkey(state, item);
+				}
+			});
 		}
 	}
 
-	void MenuNode::ResetSelected()
+	void MenuNode::SetItemStyles(const ItemStyles& styles)
 	{
-		for (auto &&item : _menuItems)
-			item->Release();
-		if (!_menuItems.empty())
-			SetFirtsSelected();
+		_itemStyles = styles;
 	}
 
-	void MenuNode::SetFirtsSelected()
+	const MenuNode::ItemStyles& MenuNode::GetItemStyles() const
 	{
-		_menuItems.front()->Select();
+		return _itemStyles;
 	}
 
-	void MenuNode::SetLastSelected()
+	MenuNode::HotkeyPolicy MenuNode::GetPolicy() const
 	{
-		_menuItems.back()->Select();
+		return _hkpolicy;
 	}
 
-	std::vector<std::shared_ptr<MenuItem>>::iterator MenuNode::GetSelectedMenuIterator()
+	void MenuNode::SetMaxVisibleMenuItems(size_t items)
 	{
-		return std::find_if(_menuItems.begin(), _menuItems.end(), [](auto&& item) { return item->IsSelected(); });
+		if (items)
+			_maxVisibleItems = items;
 	}
 
-	void MenuItem::Connect(std::function<bool()> callback)
+	void MenuNode::SetVisibleScrollPolicy(VisibleScrollPolicy policy)
 	{
-		_callback = callback;
+		_vsp = policy;
 	}
 
-	void MenuNode::AssignHotkey(std::reference_wrapper<std::shared_ptr<MenuItem>> item)
+	MenuNode::VisibleScrollPolicy MenuNode::GetVisibleScrollPolicy() const
 	{
-		switch (_hkpolicy)
+		return _vsp;
+	}
+
+	size_t MenuNode::GetMaxVisibleMenuItems() const
+	{
+		return _maxVisibleItems;
+	}
+
+	std::vector<std::shared_ptr<MenuItem>> MenuNode::GetItems() const
+	{
+		return GetSnapshot()->items.ToVector();
+	}
+
+	void* MenuItem::GetContext() const
+	{
+		return _assotiatedContext;
+	}
+
+	void MenuItem::SetCallbackId(uint32_t id)
+	{
+		_callbackId = id;
+	}
+
+	uint32_t MenuItem::GetCallbackId() const
+	{
+		return _callbackId;
+	}
+
+	void MenuItem::SetId(const tstring& id)
+	{
+		_id = id;
+	}
+
+	const tstring& MenuItem::GetStableId() const
+	{
+		return _id.empty() ? _caption : _id;
+	}
+
+	std::atomic<uint64_t> MenuItem::_deletions{ 0u };
+	std::atomic<uint64_t> MenuItem::_selections{ 0u };
+
+	void MenuItem::Delete()
+	{
+		if (!_pending_delete.exchange(true))
+			++_deletions;
+	}
+
+	bool MenuItem::Deleted() const
+	{
+		return _pending_delete;
+	}
+
+	uint64_t MenuItem::GetDeletions()
+	{
+		return _deletions;
+	}
+
+	uint64_t MenuItem::GetSelections()
+	{
+		return _selections;
+	}
+
+	unsigned short MenuNode::GetKey()
+	{
+#ifdef UNICODE
+#define GETCH  _getwch
+#else
+#define GETCH  _getch
+#endif
+		// the second code of extended key is already buffered by getch
+		static bool extended = false;
+
+		if (!extended && WaitForKey())
+			return ResizeKey;
+
+		auto ch = GETCH();
+		extended = !extended && (ch == 0 || ch == 224);
+		return ch;
+	}
+
+	LazyMenuNode::LazyMenuNode(const tstring& caption, Generator generator) :MenuNode(caption), _generator(generator)
+	{
+	}
+
+	void LazyMenuNode::Execute()
+	{
+		Expand();
+		MenuNode::Execute();
+	}
+
+	void LazyMenuNode::Expand()
+	{
+		std::lock_guard<std::mutex> lk(_expandMutex);
+
+		if (!IsMaterialized())
+			Materialize();
+	}
+
+	void LazyMenuNode::Prefetch()
+	{
+		std::lock_guard<std::mutex> lk(_lazyMutex);
+
+		if (!_generator || IsMaterializedLocked() || _prefetched)
+			return;
+
+		// thread keeps its own copies, node can be destroyed or invalidated meanwhile
+		auto prefetched = std::make_shared<Prefetched>();
+		auto generator = _generator;
+		std::thread([prefetched, generator]()
 		{
-		case HotkeyPolicy::hp_letters:
+			std::vector<std::shared_ptr<MenuItem>> items;
+			std::exception_ptr error;
+			try
+			{
+				items = generator();
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lk(prefetched->mutex);
+			prefetched->items = std::move(items);
+			prefetched->error = error;
+			prefetched->ready = true;
+			prefetched->condition.notify_all();
+		}).detach();
+
+		_prefetched = std::move(prefetched);
+	}
+
+	void LazyMenuNode::SetTimeToLive(std::chrono::milliseconds ttl)
+	{
+		std::lock_guard<std::mutex> lk(_lazyMutex);
+		_ttl = ttl;
+	}
+
+	void LazyMenuNode::Invalidate()
+	{
+		std::lock_guard<std::mutex> lk(_lazyMutex);
+
+		// result of pending prefetch is discarded when it arrives
+		_prefetched.reset();
+		_materialized = false;
+		++_generation;
+	}
+
+	bool LazyMenuNode::IsMaterialized() const
+	{
+		std::lock_guard<std::mutex> lk(_lazyMutex);
+		return IsMaterializedLocked();
+	}
+
+	bool LazyMenuNode::IsMaterializedLocked() const
+	{
+		if (!_materialized)
+			return false;
+
+		return _ttl.count() == 0 || std::chrono::steady_clock::now() - _materializedAt < _ttl;
+	}
+
+	void LazyMenuNode::Install(std::vector<std::shared_ptr<MenuItem>> items)
+	{
+		Reset();
+		for (auto&& item : items)
+			Add(std::move(item));
+	}
+
+	void LazyMenuNode::Materialize()
+	{
+		if (!_generator)
+			return;
+
+		std::shared_ptr<Prefetched> prefetched;
+		uint64_t generation;
+		{
+			std::lock_guard<std::mutex> lk(_lazyMutex);
+			prefetched = std::move(_prefetched);
+			_prefetched.reset();
+			generation = _generation;
+		}
+
+		// prefer children generated in background
+		std::vector<std::shared_ptr<MenuItem>> items;
+		if (prefetched)
+		{
+			std::unique_lock<std::mutex> lk(prefetched->mutex);
+			prefetched->condition.wait(lk, [&prefetched]() { return prefetched->ready; });
+
+			if (prefetched->error)
+				std::rethrow_exception(prefetched->error);
+			items = std::move(prefetched->items);
+		}
+		else
+		{
+			items = _generator();
+		}
+
+		// readers see old children or new ones, never a part of them
+		Batch([&]
+		{
+			Install(std::move(items));
+		});
+
+		std::lock_guard<std::mutex> lk(_lazyMutex);
+
+		// invalidated while generating, children are regenerated on the next enter
+		if (generation != _generation)
+			return;
+
+		_materializedAt = std::chrono::steady_clock::now();
+		_materialized = true;
+	}
+
+	void MenuFrame::ClearList()
+	{
+		ClearText();
+
+		std::lock_guard<std::mutex> lk(_list_mutex);
+		_list_string.Clear();
+		_line_styles.clear();
+		_trigrams.clear();
+		_wrap_layout.clear();
+		_view_first = 0u;
+		_highlight_line = tstring::npos;
+	}
+
+	void MenuFrame::AddLine(const tstring& str)
+	{
+		// frozen view does not change
+		if (Append(std::make_unique<tstring>(str)) && IsFollowingTail())
+			UpdateFromProducer(1u);
+	}
+
+	void MenuFrame::AddLine(std::unique_ptr<tstring> str)
+	{
+		Append(std::move(str));
+	}
+
+	void MenuFrame::AddLine(const StyledText& str)
+	{
+		if (Append(std::make_unique<tstring>(str.GetText()), str.GetSpans()) && IsFollowingTail())
+			UpdateFromProducer(1u);
+	}
+
+	void MenuFrame::AddLine(const tstring& str, Style style)
+	{
+		AddLine(StyledText(str, style));
+	}
+
+	bool MenuFrame::Append(std::unique_ptr<tstring> str, std::vector<StyleSpan> spans)
+	{
+		std::lock_guard<std::mutex> lk(_list_mutex);
+		return AppendLocked(std::move(str), std::move(spans));
+	}
+
+	bool MenuFrame::AppendLocked(std::unique_ptr<tstring> str, std::vector<StyleSpan> spans)
+	{
+		switch (_overload_policy)
+		{
+		case OverloadPolicy::op_drop_newest:
 		{
-			// assign hotkey by the first available in caption
-			for (auto letter : item.get()->GetCaption())
+			if (_list_string.Size() >= _overload_limit)
 			{
-				auto upper = toupper(letter);
-				if (IsHotkeyAvailable(upper))
-				{
-					// add to hotkey map
-					_hotkeys[upper] = item.get();
-					item.get()->SetHotkey(upper);
-					return;
-				}
+				++_dropped;
+				Metrics::Add(Metric::m_lines_dropped);
+				return false;
 			}
-			//todo: assign first available or dont assign at all 
 			break;
 		}
-		case HotkeyPolicy::hp_numbers:
+		case OverloadPolicy::op_drop_oldest:
 		{
-			if (_hotkeys.size() < 10)
+			while (_list_string.Size() >= _overload_limit && _list_string.Size())
 			{
-				// add to hotkey map
-				_hotkeys[_hotkeys.size() + 1u] = item.get();
-				item.get()->SetHotkey(_hotkeys.size() + 1u);
+				_list_string.PopFront();
+				_wrap_layout.erase(_list_string.First() - 1);
+				_line_styles.erase(_list_string.First() - 1);
+				++_dropped;
+				Metrics::Add(Metric::m_lines_dropped);
+				++_dropped_since_prune;
 			}
+
+			// remove dropped lines from search index once they outnumber kept ones
+			if (_dropped_since_prune > _list_string.Size())
+				PruneIndex();
 			break;
 		}
-		case HotkeyPolicy::hp_fx_keys:
+		case OverloadPolicy::op_sample:
 		{
-			auto add = 0;
-			if (_hotkeys.size() < 11)
-				add = 59;
-			else
+			// while repaints are skipped because console is busy keep every n-th line only
+			// frozen view is not repainted by producers, so it is never under pressure
+			if (_follow_tail && _unpainted > _overload_limit && ++_sampled % _sample_rate != 0)
 			{
-				if (_hotkeys.size() < 13)
-					add = 133;
+				++_dropped;
+				Metrics::Add(Metric::m_lines_dropped);
+				return false;
 			}
-			// add to hotkey map
-			_hotkeys[_hotkeys.size() + add] = item.get();
-			item.get()->SetHotkey(_hotkeys.size() + 1u);
 			break;
 		}
 		default:
 			break;
 		}
+
+		if (_search_index)
+			IndexLine(_list_string.End(), *str);
+
+		if (!spans.empty())
+			_line_styles.emplace(_list_string.End(), std::move(spans));
+
+		_list_string.Append(std::move(str));
+		++_accepted;
+		Metrics::Add(Metric::m_lines_ingested);
+		return true;
 	}
 
-	bool MenuNode::IsHotkeyAvailable(size_t hotkey)
+	StyledText MenuFrame::GetStyledLine(size_t index) const
 	{
-		return _hotkeys.find(hotkey) == _hotkeys.end() && (std::find(_illegalList.begin(), _illegalList.end(), hotkey) == _illegalList.end());
+		auto spans = _line_styles.find(index);
+		if (spans == _line_styles.end())
+			return StyledText(_list_string.Get(index));
+
+		return StyledText(_list_string.Get(index), spans->second);
 	}
 
-	bool MenuNode::IsHotKeyInUse(size_t hotkey)
+	void MenuFrame::PruneIndex()
 	{
-		return _hotkeys.find(hotkey) != _hotkeys.end();
+		auto first = static_cast<uint32_t>(_list_string.First());
+
+		for (auto it = _trigrams.begin(); it != _trigrams.end();)
+		{
+			auto& lines = it->second;
+			lines.erase(lines.begin(), std::lower_bound(lines.begin(), lines.end(), first));
+
+			if (lines.empty())
+				it = _trigrams.erase(it);
+			else
+				++it;
+		}
+		_dropped_since_prune = 0u;
 	}
 
-	std::shared_ptr<MenuItem> MenuNode::GetSelectedItem()
+	void MenuFrame::SetOverloadPolicy(OverloadPolicy policy, size_t limit, size_t sample_rate)
 	{
-		return *GetSelectedMenuIterator();
+		std::lock_guard<std::mutex> lk(_list_mutex);
+
+		_overload_policy = policy;
+		_overload_limit = limit ? limit : 1u;
+		_sample_rate = sample_rate ? sample_rate : 1u;
 	}
 
-	void MenuNode::RemoveSelectedItem()
+	MenuFrame::OverloadPolicy MenuFrame::GetOverloadPolicy() const
 	{
-		auto it = GetSelectedMenuIterator();
-		if (it != _menuItems.end())
-			it->get()->Delete();
+		return _overload_policy;
 	}
 
-	void MenuNode::AddFrame(std::shared_ptr<MenuFrame> frame)
+	MenuFrame::Counters MenuFrame::GetCounters() const
 	{
-		frame->SetConsole(_hOutput);
-		_menuFrames.emplace_back(frame);
+		return Counters{ _accepted, _dropped, _coalesced };
 	}
 
-	void MenuNode::Execute()
+	void MenuFrame::ShowCounters(bool show)
 	{
-		if (_hOutput == nullptr)
+		_show_counters = show;
+		_update_grid = true;
+		Update();
+	}
+
+	namespace
+	{
+		TCHAR Lower(TCHAR symbol)
+		{
+			return static_cast<TCHAR>(_totlower(symbol));
+		}
+
+		// count of lines copied under lock by search, producers wait for one chunk at most
+		const size_t SearchChunk{ 256u };
+
+		tstring ToLower(const tstring& str)
+		{
+			tstring lower(str);
+			std::transform(lower.begin(), lower.end(), lower.begin(), Lower);
+			return lower;
+		}
+
+		// three characters packed into the index key
+		uint64_t Trigram(const TCHAR* str)
+		{
+			return uint64_t(uint16_t(str[0])) | uint64_t(uint16_t(str[1])) << 16 | uint64_t(uint16_t(str[2])) << 32;
+		}
+
+		// true if str contains lower case query ignoring case
+		bool Contains(const tstring& str, const tstring& lowerQuery)
+		{
+			return std::search(str.begin(), str.end(), lowerQuery.begin(), lowerQuery.end(),
+				[](TCHAR left, TCHAR right) { return Lower(left) == right; }) != str.end();
+		}
+	}
+
+	void MenuFrame::IndexLine(size_t index, const tstring& str)
+	{
+		if (str.length() < 3)
 			return;
 
-		if (!_menuItems.empty())
+		auto lower = ToLower(str);
+		for (size_t i = 0u; i + 3 <= lower.length(); ++i)
 		{
-			Draw();
-			_isProcessing = true;
-			ProcessKey();
+			auto& lines = _trigrams[Trigram(&lower[i])];
+
+			// line is added once even if trigram repeats
+			if (lines.empty() || lines.back() != index)
+				lines.emplace_back(static_cast<uint32_t>(index));
+		}
+	}
+
+	void MenuFrame::SetMemoryBudget(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lk(_list_mutex);
+		_list_string.SetMemoryBudget(bytes);
+	}
+
+	void MenuFrame::SetSearchIndex(bool enable)
+	{
+		std::lock_guard<std::mutex> lk(_list_mutex);
+
+		if (enable == _search_index)
+			return;
+
+		_search_index = enable;
+		_trigrams.clear();
+
+		if (_search_index)
+		{
+			for (auto i = _list_string.First(); i < _list_string.End(); ++i)
+				IndexLine(i, _list_string.Get(i));
+		}
+	}
+
+	size_t MenuFrame::Find(const tstring& query, size_t from) const
+	{
+		if (query.empty())
+			return tstring::npos;
+
+		auto lowerQuery = ToLower(query);
+
+		// lines added after search started are not searched
+		size_t end;
+		bool indexed;
+		std::vector<uint32_t> candidates;
+		{
+			std::lock_guard<std::mutex> lk(_list_mutex);
+
+			end = _list_string.End();
+			indexed = _search_index && lowerQuery.length() >= 3;
+
+			if (indexed)
+			{
+				// only lines containing the rarest trigram of query have to be checked
+				const std::vector<uint32_t>* rarest = nullptr;
+				for (size_t i = 0u; i + 3 <= lowerQuery.length(); ++i)
+				{
+					auto lines = _trigrams.find(Trigram(&lowerQuery[i]));
+					if (lines == _trigrams.end())
+						return tstring::npos;
+
+					if (rarest == nullptr || lines->second.size() < rarest->size())
+						rarest = &lines->second;
+				}
+				candidates.assign(std::lower_bound(rarest->begin(), rarest->end(), from), rarest->end());
+			}
+		}
+
+		// lines are copied in chunks under lock and compared without it, so ingestion goes on during search
+		std::vector<std::pair<size_t, tstring>> chunk;
+		size_t candidate = 0u;
+		auto line = from;
+		for (;;)
+		{
+			chunk.clear();
+			{
+				std::lock_guard<std::mutex> lk(_list_mutex);
+
+				// dropped lines are not searched, list may be cleared meanwhile
+				auto first = _list_string.First();
+				auto last = std::min(end, _list_string.End());
+
+				if (indexed)
+				{
+					for (; candidate < candidates.size() && chunk.size() < SearchChunk; ++candidate)
+					{
+						if (candidates[candidate] >= first && candidates[candidate] < last)
+							chunk.emplace_back(candidates[candidate], _list_string.Get(candidates[candidate]));
+					}
+				}
+				else
+				{
+					for (line = std::max(line, first); line < last && chunk.size() < SearchChunk; ++line)
+						chunk.emplace_back(line, _list_string.Get(line));
+				}
+			}
+
+			if (chunk.empty())
+				return tstring::npos;
+
+			for (auto&& entry : chunk)
+			{
+				if (Contains(entry.second, lowerQuery))
+					return entry.first;
+			}
+		}
+	}
+
+	bool MenuFrame::FindNext(const tstring& query)
+	{
+		size_t from;
+		{
+			std::lock_guard<std::mutex> lk(_list_mutex);
+			from = _highlight_line == tstring::npos ? 0u : _highlight_line + 1;
+		}
+
+		auto line = Find(query, from);
+		if (line == tstring::npos && from != 0u)
+			line = Find(query);
+
+		if (line == tstring::npos)
+			return false;
+
+		ShowLine(line);
+		return true;
+	}
+
+	void MenuFrame::ShowLine(size_t line)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_list_mutex);
+
+			auto available_lines = GetAvailableLines();
+
+			// place line in the middle of frame
+			_follow_tail = false;
+			_highlight_line = line;
+			_view_first = line > available_lines / 2 ? line - available_lines / 2 : 0u;
 		}
+		Update();
 	}
 
-	void MenuNode::Reset()
+	void MenuFrame::FollowTail()
 	{
-		if (!_menuItems.empty())
 		{
-			_menuItems.clear();
-			_hotkeys.clear();
-			_hotkeyOffset = 0;
+			std::lock_guard<std::mutex> lk(_list_mutex);
+			_follow_tail = true;
+			_highlight_line = tstring::npos;
 		}
+		Update();
 	}
 
-	size_t MenuNode::GetSelectedPosition()
+	void MenuFrame::SetFollowTail(bool follow)
 	{
-		for (auto i = 0u; i < _menuItems.size(); ++i)
 		{
-			if (_menuItems[i]->IsSelected())
-				return i;
+			std::lock_guard<std::mutex> lk(_list_mutex);
+
+			if (follow == _follow_tail)
+				return;
+
+			// freeze on the lines shown now
+			if (!follow)
+				_view_first = GetFirstVisibleLine(GetAvailableLines());
+
+			_follow_tail = follow;
 		}
-		return 0;
+		Update();
 	}
 
-	bool MenuNode::Empty() const
+	bool MenuFrame::IsFollowingTail() const
 	{
-		return _menuItems.empty();
+		std::lock_guard<std::mutex> lk(_list_mutex);
+		return _follow_tail;
 	}
 
-	void MenuNode::SetPolicy(HotkeyPolicy policy)
+	void MenuFrame::Scroll(long long lines)
 	{
-		// 
-		if (policy != _hkpolicy)
 		{
-			_hkpolicy = policy;
-			_hotkeys.clear();
-			for (auto && item : _menuItems)
-				// reassign hotkeys
-				AssignHotkey(item);
+			std::lock_guard<std::mutex> lk(_list_mutex);
+
+			auto available_lines = GetAvailableLines();
+			auto first = GetFirstVisibleLine(available_lines);
+			auto last = GetLastFirstVisibleLine(available_lines);
+
+			if (lines < 0)
+				first = size_t(-lines) < first ? first - size_t(-lines) : 0u;
+			else
+				first = size_t(lines) < last - first ? first + size_t(lines) : last;
+
+			_follow_tail = false;
+			_view_first = first;
 		}
+		Update();
 	}
 
-	void MenuNode::SetMaxVisibleMenuItems(size_t items)
+	void MenuFrame::PageUp()
 	{
-		if (items)
-			_maxVisibleItems = items;
+		Scroll(-static_cast<long long>(GetAvailableLines()));
 	}
 
-	size_t MenuNode::GetMaxVisibleMenuItems() const
+	void MenuFrame::PageDown()
 	{
-		return _maxVisibleItems;
+		Scroll(static_cast<long long>(GetAvailableLines()));
 	}
 
-	const std::vector<std::shared_ptr<MenuItem>>& MenuNode::GetItems() const
+	void MenuFrame::ScrollHome()
 	{
-		return _menuItems;
+		{
+			std::lock_guard<std::mutex> lk(_list_mutex);
+			_follow_tail = false;
+			_view_first = _list_string.First();
+		}
+		Update();
 	}
 
-	void* MenuItem::GetContext() const
+	void MenuFrame::ScrollEnd()
 	{
-		return _assotiatedContext;
+		SetFollowTail(true);
 	}
 
-	void MenuItem::Delete()
+	bool MenuFrame::HandleKey(unsigned short, bool)
 	{
-		_pending_delete = true;
+		return false;
 	}
 
-	bool MenuItem::Deleted() const
+	size_t MenuFrame::GetAvailableLines() const
 	{
-		return _pending_delete;
+		auto lines = _height - (_show_horizontal_border ? 2 : 0);
+		return lines > 0 ? size_t(lines) : 1u;
 	}
 
-	unsigned short MenuNode::GetKey()
+	void MenuFrame::AddLine(const TCHAR* _pstr)
+	{
+		AddLine(tstring(_pstr));
+	}
+
+	void MenuFrame::AddLines(const LineView* lines, size_t count, UINT codePage)
 	{
+		if (count == 0)
+			return;
+
+		// lines are converted before list is locked
+		std::vector<std::unique_ptr<tstring>> converted;
+		converted.reserve(count);
+
+		for (auto line = lines; line != lines + count; ++line)
+		{
+			auto str = std::make_unique<tstring>();
 #ifdef UNICODE
-#define GETCH  _getwch
+			auto length = MultiByteToWideChar(codePage, 0, line->data, static_cast<int>(line->size), nullptr, 0);
+			if (length > 0)
+			{
+				str->resize(length);
+				MultiByteToWideChar(codePage, 0, line->data, static_cast<int>(line->size), &(*str)[0], length);
+			}
 #else
-#define GETCH  _getch
+			str->assign(line->data, line->size);
 #endif
-		return GETCH();
-	}
+			converted.emplace_back(std::move(str));
+		}
 
-	void MenuFrame::ClearList()
-	{
-		ClearText();
-		_list_string.clear();
+		AddLines(std::move(converted));
 	}
 
-	void MenuFrame::AddLine(const tstring& str)
+	void MenuFrame::AddLines(std::vector<std::unique_ptr<tstring>> lines)
 	{
-		_list_string.emplace_back(std::make_unique<tstring>(str));
-		Update();
-	}
+		size_t added = 0u;
+		{
+			std::lock_guard<std::mutex> lk(_list_mutex);
 
-	void MenuFrame::AddLine(std::unique_ptr<tstring> str)
-	{
-		_list_string.emplace_back(std::move(str));
+			for (auto&& line : lines)
+			{
+				if (AppendLocked(std::move(line)))
+					++added;
+			}
+		}
+
+		// frozen view does not change
+		if (added && IsFollowingTail())
+			UpdateFromProducer(added);
 	}
 
-	void MenuFrame::AddLine(const TCHAR* _pstr)
+	void MenuFrame::SetGeometry(short left_offset, short top_offset, short width, short height)
 	{
-		AddLine(tstring(_pstr));
+		if (left_offset == _left_offset && top_offset == _top_offet && width == _width && height == _height)
+			return;
+
+		Reshape(left_offset, top_offset, width, height);
 	}
 
 	void MenuFrame::SetHeight(short heigth)
 	{
-		_update_grid = true;
-		Clear();
-		_height = heigth;
+		Reshape(_left_offset, _top_offet, _width, heigth);
 		Update();
 	}
 
 	void MenuFrame::SetWidth(short width)
 	{
-		_update_grid = true;
-		Clear();
-		_width = width;
+		Reshape(_left_offset, _top_offet, width, _height);
 		Update();
 	}
 
@@ -689,6 +2461,28 @@ namespace Menu {
 		return _width;
 	}
 
+	void MenuFrame::SetWrapMode(bool wrap)
+	{
+		{
+			// producers and draw read mode and layout under the same lock
+			std::lock_guard<std::mutex> lk(_list_mutex);
+
+			if (_wrap_lines == wrap)
+				return;
+
+			_wrap_lines = wrap;
+			_wrap_layout.clear();
+		}
+		ClearText();
+		Update();
+	}
+
+	bool MenuFrame::GetWrapMode() const
+	{
+		std::lock_guard<std::mutex> lk(_list_mutex);
+		return _wrap_lines;
+	}
+
 	void MenuFrame::SetCaption(const tstring& str)
 	{
 		_update_grid = true;
@@ -705,87 +2499,244 @@ namespace Menu {
 		Update();
 	}
 
+	void MenuFrame::SetBorderStyle(Style style)
+	{
+		_update_grid = true;
+		_border_style = style;
+		Update();
+	}
+
+	void MenuFrame::SetCaptionStyle(Style style)
+	{
+		_update_grid = true;
+		_caption_style = style;
+		Update();
+	}
+
 	void MenuFrame::Draw()
 	{
-		if (_hOutput != nullptr)
+		TraceSpan span("MenuFrame::Draw", "render");
+
+		if (_hOutput == nullptr)
+			return;
+
+		// draw context
+		COORD coord;
+		short available_width;
+		int available_lines;
+		GetTextArea(coord, available_width, available_lines);
+
+		if (available_lines <= 0)
+			return;
+
+		// rows are prepared under lock and printed without it, producers do not wait for console output
+		auto wrap = false;
+		std::vector<VisibleRow> rows;
+		rows.reserve(available_lines);
 		{
-			// draw context
-			auto available_width = _width;
+			std::lock_guard<std::mutex> lk(_list_mutex);
 
-			COORD coord = { _left_offset, _top_offet };
+			wrap = _wrap_lines && available_width > 0;
+			if (wrap)
+				CollectWrapped(available_width, available_lines, rows);
+			else if (!_wrap_lines)
+				CollectTruncated(available_width, available_lines, rows);
+		}
+
+		for (auto&& row : rows)
+		{
+			PrintRow(coord, row.text, available_width, row.highlight);
+			++coord.Y;
+		}
+
+		// wrapped view may take less rows than before
+		for (auto i = rows.size(); wrap && i < size_t(available_lines); ++i)
+		{
+			PrintRow(coord, StyledText(), available_width, false);
+			++coord.Y;
+		}
+	}
+
+	void MenuFrame::CollectTruncated(short available_width, int available_lines, std::vector<VisibleRow>& rows) const
+	{
+		auto firstListIter = GetFirstVisibleLine(available_lines);
+
+		auto realLines = available_lines > _list_string.Size() ? _list_string.Size() : available_lines;
 
-			if (_show_vertical_border)
+		for (auto i = 0u; i < realLines; ++i)
+		{
+			auto line = GetStyledLine(firstListIter);
+			auto lineWidth = Text::Width(line.GetText());
+
+			if (lineWidth > size_t(available_width))
 			{
-				++coord.X;
-				available_width -= 2;
-				if (_width < 0)
-					available_width = 0;
+				auto truncated = Text::Truncate(line.GetText(), available_width > 3 ? available_width - 3 : 0);
+				rows.emplace_back(VisibleRow{ line.Substr(0u, truncated.length()).Append(_T("...")), firstListIter == _highlight_line });
 			}
+			else
+				rows.emplace_back(VisibleRow{ std::move(line), firstListIter == _highlight_line });
 
-			if (_show_horizontal_border)
-				coord.Y += 1;
+			++firstListIter;
+		}
+	}
 
-			int available_lines = _height - (_show_horizontal_border ? 2u : 0u);
+	bool MenuFrame::GetTextArea(COORD& origin, short& width, int& lines) const
+	{
+		width = _width;
+		origin = { _left_offset, _top_offet };
 
-			if (available_lines > 0)
-			{
-				//
-				auto firstListIter = 0;
+		if (_show_vertical_border)
+		{
+			++origin.X;
+			width -= 2;
+			if (width < 0)
+				width = 0;
+		}
 
-				if (_list_string.size() > available_lines)
-				{
-					firstListIter = _list_string.size() - available_lines;
-				}
+		if (_show_horizontal_border)
+			origin.Y += 1;
 
-				auto realLines = available_lines > _list_string.size() ? _list_string.size() : available_lines;
+		lines = _height - (_show_horizontal_border ? 2 : 0);
 
-				for (auto i = 0; i < realLines; ++i)
-				{
-					if (SetConsoleCursorPosition(_hOutput, coord) == 0)
-					{
-						auto ret = GetLastError();
-						assert(false);
-					}
-					++coord.Y;
+		return width > 0 && lines > 0;
+	}
 
-					if (_list_string.at(firstListIter).get()->length() > available_width)
-						_outstream << _list_string.at(firstListIter).get()->substr(0, available_width - 3) << _T("...");
-					else
-						_outstream << std::left << std::setw(_width - 2) << std::setfill(_T(' ')) << *(_list_string.at(firstListIter).get());
+	void MenuFrame::CollectWrapped(short available_width, int available_lines, std::vector<VisibleRow>& rows)
+	{
+		// only lines which are visible now are laid out, so cost does not depend on the list size
+		std::unordered_map<size_t, LineLayout> layout;
 
-					++firstListIter;
-				}
+		auto getLayout = [&](size_t line) -> LineLayout&
+		{
+			auto cached = _wrap_layout.find(line);
+			auto& lineLayout = layout[line];
+
+			// reuse break positions calculated for the same width
+			if (cached != _wrap_layout.end() && cached->second.width == available_width)
+				lineLayout = std::move(cached->second);
+			else
+				lineLayout = LineLayout{ available_width, BreakLine(_list_string.Get(line), available_width) };
+
+			return lineLayout;
+		};
+
+		// visible rows: line index and row of the line
+		std::vector<std::pair<size_t, size_t>> positions;
+		positions.reserve(available_lines);
+
+		if (_follow_tail)
+		{
+			// collect from the bottom
+			for (auto line = _list_string.End(); line-- > _list_string.First() && positions.size() < size_t(available_lines);)
+			{
+				auto& lineLayout = getLayout(line);
+				for (auto row = lineLayout.breaks.size() + 1; row-- > 0 && positions.size() < size_t(available_lines);)
+					positions.emplace_back(line, row);
+			}
+			std::reverse(positions.begin(), positions.end());
+		}
+		else
+		{
+			// collect from the first line of view
+			for (auto line = std::max(_view_first, _list_string.First()); line < _list_string.End() && positions.size() < size_t(available_lines); ++line)
+			{
+				auto& lineLayout = getLayout(line);
+				for (auto row = 0u; row <= lineLayout.breaks.size() && positions.size() < size_t(available_lines); ++row)
+					positions.emplace_back(line, row);
 			}
 		}
+
+		_wrap_layout.swap(layout);
+
+		for (auto&& position : positions)
+		{
+			auto str = GetStyledLine(position.first);
+			auto& breaks = _wrap_layout[position.first].breaks;
+
+			auto begin = position.second == 0 ? 0u : breaks[position.second - 1];
+			auto end = position.second < breaks.size() ? breaks[position.second] : str.GetText().length();
+
+			rows.emplace_back(VisibleRow{ str.Substr(begin, end - begin), position.first == _highlight_line });
+		}
+	}
+
+	void MenuFrame::PrintRow(COORD coord, const StyledText& str, short available_width, bool highlight)
+	{
+		auto width = Text::Width(str.GetText());
+		auto row = str;
+		row.Append(tstring(width < size_t(available_width) ? available_width - width : 0u, _T(' ')));
+
+		// highlighted row keeps its colors reversed
+		if (highlight)
+			row.AddFlags(Style::sf_reverse);
+
+		Write(coord, row);
+	}
+
+	size_t MenuFrame::GetFirstVisibleLine(size_t available_lines) const
+	{
+		auto last = GetLastFirstVisibleLine(available_lines);
+
+		if (_follow_tail)
+			return last;
+
+		// keep screen filled when view is close to the end
+		if (_view_first < _list_string.First())
+			return _list_string.First();
+
+		return _view_first < last ? _view_first : last;
+	}
+
+	size_t MenuFrame::GetLastFirstVisibleLine(size_t available_lines) const
+	{
+		return _list_string.Size() > available_lines ? _list_string.End() - available_lines : _list_string.First();
+	}
+
+	std::vector<size_t> MenuFrame::BreakLine(const tstring& str, short width)
+	{
+		std::vector<size_t> breaks;
+
+		size_t pos = 0u;
+		while (pos < str.length())
+		{
+			// first character which does not fit the row
+			auto end = Text::Fit(str, pos, width);
+			if (end == str.length())
+				break;
+
+			// prefer to break on the last space which fits the row, space is kept at the end of row
+			auto space = end > pos ? str.rfind(_T(' '), end - 1u) : tstring::npos;
+			auto next = space != tstring::npos && space > pos ? space + 1 : end;
+
+			// character wider than the row takes it alone
+			if (next == pos)
+				next = Text::Fit(str, pos, 2u) > pos ? Text::Fit(str, pos, 2u) : pos + 1;
+
+			breaks.emplace_back(next);
+			pos = next;
+		}
+		return breaks;
 	}
 
 	void MenuFrame::Clear()
 	{
-		std::lock_guard<std::mutex> lk(global_set_pos_mutex);
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
 
 		if (_hOutput)
 		{
-			CONSOLE_SCREEN_BUFFER_INFO csbi;
-			GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
-
-			const auto maxLength = csbi.dwSize.X - 1;
-			const auto rightBoeder = _width + _left_offset - 1;
-			const auto clearLength = (rightBoeder > maxLength ? maxLength : rightBoeder) - _left_offset;
+			// compositor clips row to console width
+			const tstring blank(_width > 0 ? _width : 0, _T(' '));
 
 			COORD coord = { _left_offset, _top_offet };
-			for (auto i = 0u; i < _height; ++i)
+			for (auto i = 0; i < _height; ++i)
 			{
-				// If the function fails, the return value is zero.
-				if (SetConsoleCursorPosition(_hOutput, coord) == 0)
-				{
-					auto ret = GetLastError();
-					assert(false && "failed to SetConsoleCursorPosition");
-				}
-				_outstream << _T(' ') << std::setfill(_T(' ')) << std::setw(clearLength) << _T(' ');
+				Write(coord, blank);
 
 				//
 				++coord.Y;
 			}
+			Compositor::Instance().Present(_hOutput, _outstream);
+			_outstream.flush();
 			_update_grid = true;
 		}
 	}
@@ -800,14 +2751,64 @@ namespace Menu {
 		_caption = str;
 	}
 
+	MenuFrame::~MenuFrame()
+	{
+		Compositor::Instance().Unregister(this);
+	}
+
 	void MenuFrame::SetLeftOffset(short left_offset)
 	{
-		_left_offset = left_offset;
+		Reshape(left_offset, _top_offet, _width, _height);
+		if (_on_screen)
+			Update();
 	}
 
 	void MenuFrame::SetTopOffset(short top_offset)
 	{
+		Reshape(_left_offset, top_offset, _width, _height);
+		if (_on_screen)
+			Update();
+	}
+
+	SMALL_RECT MenuFrame::GetRect() const
+	{
+		return SMALL_RECT{ _left_offset, _top_offet, static_cast<SHORT>(_left_offset + _width - 1), static_cast<SHORT>(_top_offet + _height - 1) };
+	}
+
+	void MenuFrame::Reshape(short left_offset, short top_offset, short width, short height)
+	{
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+
+		auto old = GetRect();
+
+		_left_offset = left_offset;
 		_top_offet = top_offset;
+		_width = width;
+		_height = height;
+		_update_grid = true;
+
+		auto& compositor = Compositor::Instance();
+		compositor.SetRect(this, GetRect(), _on_screen);
+
+		// new area is drawn by the next update
+		if (_on_screen)
+			compositor.Reveal(_hOutput, _outstream, old, this);
+	}
+
+	void MenuFrame::Recompose()
+	{
+		_update_grid = true;
+		Repaint();
+	}
+
+	void MenuFrame::Write(COORD coord, const tstring& str) const
+	{
+		Compositor::Instance().Write(this, _hOutput, _outstream, coord, str);
+	}
+
+	void MenuFrame::Write(COORD coord, const StyledText& str) const
+	{
+		Compositor::Instance().Write(this, _hOutput, _outstream, coord, str);
 	}
 
 	bool MenuFrame::IsVisible() const
@@ -817,46 +2818,134 @@ namespace Menu {
 
 	void MenuFrame::Hide()
 	{
-		Clear();
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+
+		if (!_is_visible)
+			return;
+
 		_is_visible = false;
-		Update();
+		_unpainted = 0u;
+
+		// frames and menu below take the area back
+		auto& compositor = Compositor::Instance();
+		compositor.SetRect(this, GetRect(), false);
+		if (_on_screen)
+			compositor.Reveal(_hOutput, _outstream, GetRect());
+
+		_on_screen = false;
 	}
 
 	void MenuFrame::Show()
 	{
-		_is_visible = true;
+		{
+			MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+
+			if (!_is_visible)
+			{
+				_is_visible = true;
+				_update_grid = true;
+			}
+		}
 		Update();
 	}
 
+	void MenuFrame::BringToFront()
+	{
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+
+		Compositor::Instance().Raise(this);
+
+		// cells covered before are drawn
+		_update_grid = true;
+		Repaint();
+	}
+
+	void MenuFrame::SendToBack()
+	{
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+
+		auto& compositor = Compositor::Instance();
+		compositor.Lower(this);
+
+		// surfaces above draw over the frame
+		if (_on_screen)
+			compositor.Reveal(_hOutput, _outstream, GetRect());
+	}
+
 	void MenuFrame::Update()
 	{
-		std::lock_guard<std::mutex> lk(global_set_pos_mutex);
+		TraceSpan span("MenuFrame::Update", "render");
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+		Repaint();
+	}
+
+	void MenuFrame::UpdateFromProducer(size_t lines)
+	{
+		if (_overload_policy == OverloadPolicy::op_block)
+		{
+			Update();
+			return;
+		}
+
+		TraceSpan span("MenuFrame::UpdateFromProducer", "render");
+
+		// producer never waits for console, skipped lines are drawn by the next repaint
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock, std::try_to_lock);
+		if (!lk.owns_lock())
+		{
+			_coalesced += lines;
+
+			// hidden frame has nothing to draw
+			if (_is_visible && _hOutput != nullptr)
+				_unpainted += lines;
+			return;
+		}
+		Repaint();
+	}
+
+	void MenuFrame::Repaint()
+	{
+		// lines added so far are drawn now or not shown at all
+		_unpainted = 0u;
+
+		if (!_is_visible || _hOutput == nullptr)
+			return;
+
+		Metrics::Add(Metric::m_repaints);
+
+		if (!_on_screen)
+		{
+			_on_screen = true;
+			Compositor::Instance().SetRect(this, GetRect(), true);
+		}
 
 		if (_update_grid)
 			DrawGrid();
+		else if (_show_counters)
+			DrawGrid(true);
 		Draw();
+
+		Compositor::Instance().Present(_hOutput, _outstream);
 	}
 
-	void MenuFrame::DrawGrid()
+	void MenuFrame::DrawGrid(bool caption_row_only)
 	{
+		TraceSpan span("MenuFrame::DrawGrid", "render");
+
 		if (_hOutput != nullptr)
 		{
 			//draw grid
-			CONSOLE_SCREEN_BUFFER_INFO csbi;
-			GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
-
-			const auto maxLength = csbi.dwSize.X - 1;
+			const auto maxLength = ConsoleGeometry::GetSize().X - 1;
 			const auto rightBoeder = _width + _left_offset;
 			const auto clearLength = (rightBoeder > maxLength ? maxLength : rightBoeder) - _left_offset - (_show_vertical_border ? 2 : 0) + 1;
 
 			COORD coord = { _left_offset, _top_offet };
 
 			const auto beforelast = _height - 1;
+			const auto rows = caption_row_only ? (_height > 0 ? 1 : 0) : _height;
 
-			for (auto i = 0u; i < _height; ++i)
+			for (auto i = 0u; i < rows; ++i)
 			{
-				SetConsoleCursorPosition(_hOutput, coord);
-
 				TCHAR  ls = _T(' ');
 				TCHAR  rs = _T(' ');
 				TCHAR  hs = _T(' ');
@@ -882,37 +2971,55 @@ namespace Menu {
 						hs = _horizontal_border_symbol;
 				}
 
-				_outstream
-					<< ls << std::right
-					<< std::setfill(hs)
-					<< std::setw(clearLength)
-					<< rs;
+				// inner cells of rows without border keep default colors
+				if (_border_style.IsDefault() || (hs == _T(' ') && ls == _T(' ')))
+					Write(coord, ls + tstring(clearLength > 1 ? clearLength - 1 : 0, hs) + rs);
+				else if (hs == _T(' '))
+					Write(coord, StyledText(tstring(1, ls), _border_style).Append(tstring(clearLength > 1 ? clearLength - 1 : 0, hs)).Append(tstring(1, rs), _border_style));
+				else
+					Write(coord, StyledText(ls + tstring(clearLength > 1 ? clearLength - 1 : 0, hs) + rs, _border_style));
 
 				// draw caption
 				if (_show_caption && i == 0)
 				{
 
-					auto visible_size = _caption.size() > clearLength ? clearLength : _caption.size();
+					auto caption = GetCaptionText();
+					auto caption_width = Text::Width(caption);
+					auto visible_size = caption_width > clearLength ? clearLength : caption_width;
 					short half_of_visible = visible_size / 2;
 
 					//
 					short left_offset = clearLength / 2 - half_of_visible;
 
 					//
-					SetConsoleCursorPosition(_hOutput, COORD{ left_offset + _left_offset, coord.Y });
-					_outstream << _caption;
+					Write(COORD{ static_cast<SHORT>(left_offset + _left_offset), coord.Y }, StyledText(Text::Truncate(caption, visible_size), _caption_style));
 				}
 
 				//
 				++coord.Y;
 			}
-			_update_grid = false;
+			if (!caption_row_only)
+			{
+				_update_grid = false;
+				OnGridDrawn();
+			}
 		}
 	}
 
+	tstring MenuFrame::GetCaptionText() const
+	{
+		if (!_show_counters)
+			return _caption;
+
+		auto counters = GetCounters();
+		return _caption + _T(" [+") + Text::Number(counters.accepted) + _T(" -") + Text::Number(counters.dropped)
+			+ _T(" ~") + Text::Number(counters.coalesced) + _T("]");
+	}
+
 	size_t MenuFrame::GetLineSize() const
 	{
-		return _list_string.size();
+		std::lock_guard<std::mutex> lk(_list_mutex);
+		return _list_string.Size();
 	}
 
 	void MenuFrame::ClearText() const
@@ -921,13 +3028,15 @@ namespace Menu {
 		auto coords = COORD{ _left_offset + (_show_vertical_border ? 1: 0 ), _top_offet + (_show_horizontal_border ? 1 : 0) };
 		auto vertical = _height - (_show_horizontal_border ? 2 : 0);
 		const auto hor = _width - (_show_vertical_border ? 2 : 0);
-		DWORD count;
+		const tstring blank(hor > 0 ? hor : 0, _T(' '));
 
-		while (vertical--)
+		MeteredLock lk(global_set_pos_mutex, Metrics::ConsoleLock);
+		while (vertical-- > 0)
 		{
-			std::lock_guard<std::mutex> lk(global_set_pos_mutex);
-			FillConsoleOutputCharacter(_hOutput, _T(' '), hor, coords, &count);
+			Write(coords, blank);
 			++coords.Y;
 		}
+		Compositor::Instance().Present(_hOutput, _outstream);
+		_outstream.flush();
 	}
 }
@@ -4,24 +4,78 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <iterator>
 #include <functional>
 #include <map>
+#include <unordered_map>
 #include <list>
 #include <windows.h>
 #include <TCHAR.h>
 #include <iostream>
 #include <mutex>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#include "TextWidth.h"
+#include "Scrollback.h"
+#include "ConsoleGeometry.h"
+#include "Compositor.h"
+#include "Style.h"
+#include "HotkeyAllocator.h"
+#include "PathIndex.h"
+#include "ChunkedList.h"
 
 #undef GetMessage
 
 namespace Menu
 {
 
+	class Layout;
+	class MetricsFrame;
+
 	using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
 	using tcout = std::basic_ostream<TCHAR, std::char_traits<TCHAR>>;
 
-	class MenuFrame
+	// not owned line of encoded text
+	struct LineView
+	{
+		const char* data;
+		size_t size;
+	};
+
+	class MenuFrame : public Surface
 	{
+	public:
+
+		// what to do when producers add lines faster than frame is drawn
+		enum class OverloadPolicy
+		{
+			// producer waits for every repaint, lines are never lost
+			op_block,
+			// keep at most limit lines removing the oldest ones
+			op_drop_oldest,
+			// keep at most limit lines rejecting new ones
+			op_drop_newest,
+			// after limit lines wait for repaint skipped because console is busy keep only every n-th
+			op_sample,
+		};
+
+		// lines statistics
+		struct Counters
+		{
+			// lines added to the list
+			uint64_t accepted;
+			// lines rejected or removed by overload policy
+			uint64_t dropped;
+			// lines drawn by later repaint because console was busy
+			uint64_t coalesced;
+		};
+
+	private:
+
 		/*
 		 * Todo
 		 * 1. Aligement
@@ -46,7 +100,7 @@ namespace Menu
 		bool _show_caption{ true };
 
 		//
-		bool _is_visible{ true };
+		std::atomic<bool> _is_visible{ true };
 
 		//
 		short _width{ 40u };
@@ -81,14 +135,139 @@ namespace Menu
 		//
 		short _left_offset{ 0u };
 
-		//
-		std::vector <std::unique_ptr <tstring>> _list_string;
+		// lines, older ones may be moved out of memory
+		Scrollback _list_string;
 
-		//
-		void DrawGrid();
+		// wrap long lines instead of truncating them
+		bool _wrap_lines{ false };
 
-		//
-		void Draw();
+		// positions where wrapped line continues on the next row
+		struct LineLayout
+		{
+			short width;
+			std::vector<size_t> breaks;
+		};
+
+		// layouts of lines shown by the last draw, keyed by line index
+		std::unordered_map<size_t, LineLayout> _wrap_layout;
+
+		// style runs of styled lines keyed by line index, plain lines have no entry
+		std::map<size_t, std::vector<StyleSpan>> _line_styles;
+
+		// style of borders and caption
+		Style _border_style;
+		Style _caption_style;
+
+		// guards list of strings, search index and layouts
+		mutable std::mutex _list_mutex;
+
+		// true if the last lines are shown, otherwise view starts from _view_first
+		bool _follow_tail{ true };
+
+		// first visible line when tail is not followed
+		size_t _view_first{ 0u };
+
+		// line shown highlighted, npos if none
+		size_t _highlight_line{ tstring::npos };
+
+		// maintain trigram index of lines for search
+		bool _search_index{ true };
+
+		// sorted indexes of lines for every trigram of lower case text
+		std::unordered_map<uint64_t, std::vector<uint32_t>> _trigrams;
+
+		// overload handling
+		OverloadPolicy _overload_policy{ OverloadPolicy::op_block };
+		size_t _overload_limit{ 0u };
+		size_t _sample_rate{ 1u };
+
+		// lines added while console was busy, they wait for the next repaint
+		std::atomic<size_t> _unpainted{ 0u };
+
+		// lines arrived while sampling, every n-th of them is kept
+		size_t _sampled{ 0u };
+
+		// lines dropped after the last cleaning of search index
+		size_t _dropped_since_prune{ 0u };
+
+		// statistics
+		std::atomic<uint64_t> _accepted{ 0u };
+		std::atomic<uint64_t> _dropped{ 0u };
+		std::atomic<uint64_t> _coalesced{ 0u };
+
+		// show statistics in caption
+		bool _show_counters{ false };
+
+		// add line to the list and search index according to overload policy
+		// return false if line is dropped
+		bool Append(std::unique_ptr<tstring> str, std::vector<StyleSpan> spans = {});
+
+		// the same as Append, list must be locked
+		bool AppendLocked(std::unique_ptr<tstring> str, std::vector<StyleSpan> spans = {});
+
+		// return line with its style runs, list must be locked
+		StyledText GetStyledLine(size_t index) const;
+
+		// remove dropped lines from search index
+		void PruneIndex();
+
+		// draw grid if needed and text, console must be locked
+		void Repaint();
+
+		// update after lines are added, does not wait for console unless policy is op_block
+		void UpdateFromProducer(size_t lines);
+
+		// return caption with statistics if they are shown
+		tstring GetCaptionText() const;
+
+		// return the first line on screen when tail is followed
+		size_t GetLastFirstVisibleLine(size_t available_lines) const;
+
+		// add trigrams of line to the search index
+		void IndexLine(size_t index, const tstring & str);
+
+		// return index of the first line on screen
+		size_t GetFirstVisibleLine(size_t available_lines) const;
+
+		// return count of rows available for text
+		size_t GetAvailableLines() const;
+
+		// move view by count of lines, negative - up
+		void Scroll(long long lines);
+
+		// print one row of text padded to width
+		void PrintRow(COORD coord, const StyledText & str, short available_width, bool highlight);
+
+		// draw borders and caption, only the first row if caption_row_only
+		void DrawGrid(bool caption_row_only = false);
+
+		// row of text prepared for printing
+		struct VisibleRow
+		{
+			StyledText text;
+			bool highlight;
+		};
+
+		// collect visible part of the list truncating long lines, list must be locked
+		void CollectTruncated(short available_width, int available_lines, std::vector<VisibleRow>& rows) const;
+
+		// collect visible part of the list wrapping long lines, list must be locked
+		void CollectWrapped(short available_width, int available_lines, std::vector<VisibleRow>& rows);
+
+		// calculate positions of rows continuation for width
+		static std::vector<size_t> BreakLine(const tstring & str, short width);
+
+		// true if frame was drawn since it was shown
+		bool _on_screen{ false };
+
+		// return rectangle taken by frame
+		SMALL_RECT GetRect() const;
+
+		// change geometry, cells left by frame are recomposed from surfaces below it
+		void Reshape(short left_offset, short top_offset, short width, short height);
+
+		// repaint everything, console is locked
+		void Recompose() override;
 
 		//
 		void Clear();
@@ -111,13 +290,27 @@ namespace Menu
 		// hadle for console output
 		HANDLE _hOutput{ nullptr };
 
+		// draw text inside borders, console is locked
+		virtual void Draw();
+
+		// called after borders are drawn and text area is blank
+		virtual void OnGridDrawn() {};
+
+		// calculate position and size of text area inside borders
+		// return false if there is no space for text
+		bool GetTextArea(COORD & origin, short & width, int & lines) const;
+
+		// write text at position through compositor, console is locked
+		void Write(COORD coord, const tstring & str) const;
+		void Write(COORD coord, const StyledText & str) const;
+
 	public:
 
 		// c-tor
 		explicit MenuFrame(const tstring& str);
 
 		// d-tor
-		~MenuFrame() = default;
+		virtual ~MenuFrame();
 
 		//
 		void SetConsole(HANDLE console_handle);
@@ -128,15 +321,47 @@ namespace Menu
 		void AddLine(std::unique_ptr<tstring> str);
 		void AddLine(const TCHAR * _pstr);
 
+		// add line with colors and attributes
+		void AddLine(const StyledText & str);
+		void AddLine(const tstring & str, Style style);
+
+		// add encoded lines converting them straight into the list, frame is updated once
+		void AddLines(const LineView * lines, size_t count, UINT codePage = CP_UTF8);
+
+		// add lines under one lock of the list, frame is updated once
+		void AddLines(std::vector<std::unique_ptr<tstring>> lines);
+
+		// add strings of range of forward iterators, use std::make_move_iterator to move them in
+		template <class Iterator>
+		void AddLines(Iterator first, Iterator last)
+		{
+			std::vector<std::unique_ptr<tstring>> lines;
+			lines.reserve(std::distance(first, last));
+			for (; first != last; ++first)
+				lines.emplace_back(std::make_unique<tstring>(*first));
+			AddLines(std::move(lines));
+		}
+
 		void SetHeight(short heigth);
 		void SetWidth(short width);
 
 		short GetHeight() const;
 		short GetWidth() const;
 
+		// move and resize frame at once, old area is cleared and grid is drawn by the next update
+		void SetGeometry(short left_offset, short top_offset, short width, short height);
+
+		// wrap long lines to the next rows instead of truncating
+		void SetWrapMode(bool wrap);
+		bool GetWrapMode() const;
+
 		void SetCaption(const tstring & str);
 		void SetCaption(const TCHAR * _pstr);
 
+		// colors of borders and caption
+		void SetBorderStyle(Style style);
+		void SetCaptionStyle(Style style);
+
 		//
 		void SetLeftOffset(short left_offset);
 		void SetTopOffset(short top_offset);
@@ -146,40 +371,101 @@ namespace Menu
 		void Hide();
 		void Show();
 
+		// move frame above or below other frames and menu, frame which is not on screen enters on top when it is shown
+		void BringToFront();
+		void SendToBack();
+
 		//
 		void Update();
 
 		// return count of lines
 		size_t GetLineSize() const;
+
+		// set policy applied when lines arrive faster than frame is drawn
+		// limit - count of kept lines for drop policies, lines arrived without repaint for sampling
+		void SetOverloadPolicy(OverloadPolicy policy, size_t limit = 0u, size_t sample_rate = 10u);
+		OverloadPolicy GetOverloadPolicy() const;
+
+		// return lines statistics
+		Counters GetCounters() const;
+
+		// show lines statistics in caption
+		void ShowCounters(bool show);
+
+		// set size of lines kept in memory in bytes, older lines are moved to temporary file
+		// 0 - keep everything in memory
+		void SetMemoryBudget(size_t bytes);
+
+		// enable or disable search index, disabled search scans all lines
+		void SetSearchIndex(bool enable);
+
+		// return index of the first line from position which contains query ignoring case
+		// return npos if not found
+		size_t Find(const tstring & query, size_t from = 0u) const;
+
+		// show and highlight the next line which contains query, search wraps around
+		// return false if not found
+		bool FindNext(const tstring & query);
+
+		// stop following tail and show line highlighted
+		void ShowLine(size_t line);
+
+		// show the last lines as they arrive
+		void FollowTail();
+
+		// freeze view on the lines shown now or follow the tail again
+		void SetFollowTail(bool follow);
+		bool IsFollowingTail() const;
+
+		// scroll view, new lines do not repaint frame until tail is followed again
+		virtual void PageUp();
+		virtual void PageDown();
+		virtual void ScrollHome();
+		virtual void ScrollEnd();
+
+		// handle key not used by menu while frame is active, extended - key came after 0 or 224 prefix
+		// return true if key is handled
+		virtual bool HandleKey(unsigned short code, bool extended);
 	};
 
 	class MenuItem
 	{
+		// flags are atomic, items are shared by snapshots read without locks
+
 		// true if marked as deleted
-		bool _pending_delete{ false };
+		std::atomic<bool> _pending_delete{ false };
+
+		// count of items ever marked as deleted, nodes look for deleted items only when it changes
+		static std::atomic<uint64_t> _deletions;
+
+		// count of items ever marked as selected, nodes trust remembered selection only while it does not change
+		static std::atomic<uint64_t> _selections;
 
 		// 
-		bool _callbackResult{ false };
+		std::atomic<bool> _callbackResult{ false };
 
 		// 
-		bool _showMessage{ false };
+		std::atomic<bool> _showMessage{ false };
 
 	protected:
 
 		// menu text 
 		tstring _caption{ _T("") };
 
+		// count of columns taken by caption
+		size_t _captionWidth{ 0u };
+
 		// hotkey 0-if not in use
-		size_t _hotkey{ 0u };
+		std::atomic<size_t> _hotkey{ 0u };
 
 		// callback
 		std::function<bool()> _callback{ nullptr };
 
 		// true if menu item is visible
-		bool _isVisible{ true };
+		std::atomic<bool> _isVisible{ true };
 
 		// true if item is selected
-		bool _isSelected{ false };
+		std::atomic<bool> _isSelected{ false };
 
 		// message shown after callback executes with error
 		tstring _errorMessage{ _T("Error") };
@@ -187,19 +473,29 @@ namespace Menu
 		// message shown after callback executes with success
 		tstring _successMessage{ _T("Success") };
 
+		// count of columns taken by messages
+		size_t _errorWidth{ 5u };
+		size_t _successWidth{ 7u };
+
 		// true if error or success message are visible
 		bool _alwaysShowMessage{ true };
 
 		// context assotiated with this menu
 		void * _assotiatedContext{ nullptr };
 
+		// identifier used to rebind callback after loading, 0-if not in use
+		uint32_t _callbackId{ 0u };
+
+		// identifier kept by new versions of item, empty if caption identifies it
+		tstring _id;
+
 	public:
 
 		// default c-tor
 		MenuItem() = default;
 
 		// c-tor
-		explicit MenuItem(const tstring &caption) :_caption(caption) {};
+		explicit MenuItem(const tstring &caption) :_caption(caption), _captionWidth(Text::Width(caption)) {};
 
 		// virtual d-tor
 		virtual ~MenuItem() = default;
@@ -223,7 +519,15 @@ namespace Menu
 		void Hide();
 
 		// run callbalck if it is available and make message visible
-		void RunCallback();
+		// return result of callback, false if item has no callback
+		bool RunCallback();
+
+		// run callback if it is available, message and state of menu are not changed
+		// return result of callback, false if item has no callback
+		bool InvokeCallback();
+
+		// return true if callback is connected
+		bool HasCallback() const;
 
 		// connect callback to menu item or node OnEnter event
 		void Connect(std::function<bool()> callback);
@@ -247,10 +551,19 @@ namespace Menu
 		// if callback executed successfull return success message else error message
 		const tstring& GetMessage();
 
+		// return message shown for result of callback, message visibility is not changed
+		const tstring& GetMessage(bool success) const;
+
+		// return count of columns taken by message shown for result of callback
+		size_t GetMessageWidth(bool success) const;
+
+		// return true if the last callback succeeded
+		bool GetCallbackResult() const;
+
 		// return assigned hotkey
 		size_t GetHotKey() const;
 
-		// return length of item's caption
+		// return count of columns taken by item's caption
 		size_t GetCaptionLength() const;
 
 		// set error message
@@ -262,20 +575,41 @@ namespace Menu
 		//
 		virtual void Execute() {};
 
+		// hint that item is likely to be executed soon, e.g. it became selected
+		virtual void Prefetch() {};
+
 		//
 		void SetContext(void* context);
 
 		//
 		void * GetContext() const;
 
+		// set identifier used to rebind callback when menu is loaded from image
+		void SetCallbackId(uint32_t id);
+
+		// return callback identifier
+		uint32_t GetCallbackId() const;
+
+		// set identifier used to match item with its new version on reload, set before item is added
+		void SetId(const tstring& id);
+
+		// return identifier or caption if it is not set
+		const tstring& GetStableId() const;
+
 		//
 		void Delete();
 
 		//
 		bool Deleted() const;
+
+		// return count of items ever marked as deleted
+		static uint64_t GetDeletions();
+
+		// return count of items ever marked as selected
+		static uint64_t GetSelections();
 	};
 
-	class MenuNode : public MenuItem
+	class MenuNode : public MenuItem, public Surface
 	{
 	public:
 
@@ -284,7 +618,7 @@ namespace Menu
 		{
 			// do not generate hotkeys
 			hp_none,
-			// the first available letter in caption, A-Z
+			// the first available letter or digit in caption, A-Z and 0-9
 			hp_letters,
 			// index by value from 1 to 9
 			hp_numbers,
@@ -292,13 +626,32 @@ namespace Menu
 			hp_fx_keys,
 		};
 
+		// position of selected item in window of visible items
 		enum class VisibleScrollPolicy
 		{
+			// in the middle
 			vsp_center,
+			// at the top, items below it are shown
 			vsp_down,
+			// at the bottom, items above it are shown
 			vsp_up
 		};
 
+		// colors of menu rows
+		struct ItemStyles
+		{
+			// caption of selected item
+			Style selected;
+			// hotkey tag
+			Style hotkey;
+			// message after callback succeeded or failed
+			Style success;
+			Style error;
+
+			// c-tor
+			ItemStyles() :selected(Color::c_default, Color::c_default, Style::sf_bold), hotkey(Color::c_light_cyan), success(Color::c_light_green), error(Color::c_light_red) {};
+		};
+
 		// c-tor
 		explicit MenuNode(const tstring &caption);
 
@@ -308,6 +661,20 @@ namespace Menu
 		// Adds new menu item. If need to delegate ownage use std::move
 		void Add(std::shared_ptr<MenuItem> node);
 
+		// Adds new menu item with hotkey code chosen by caller instead of policy
+		// code is the key processed by node: letter, number or Fx scan code
+		void Add(std::shared_ptr<MenuItem> node, size_t hotkey);
+
+		// Adds menu items at once: items are published by one copy of the list and node is redrawn once
+		void AddRange(std::vector<std::shared_ptr<MenuItem>> nodes);
+
+		// Adds menu items of range of iterators, use std::make_move_iterator to move them in
+		template <class Iterator>
+		void AddRange(Iterator first, Iterator last)
+		{
+			AddRange(std::vector<std::shared_ptr<MenuItem>>(first, last));
+		}
+
 		// Call menu
 		void Execute() override;
 
@@ -323,8 +690,54 @@ namespace Menu
 		// sets hotkey generation policy
 		void SetPolicy(HotkeyPolicy policy);
 
-		// return const reference to menu items
-		const std::vector<std::shared_ptr<MenuItem>>& GetItems() const;
+		// return hotkey generation policy
+		HotkeyPolicy GetPolicy() const;
+
+		// return hotkey code of item as taken by Add, 0 if item has no hotkey
+		size_t GetHotkeyCode(const MenuItem* item) const;
+
+		// set colors of rows, nodes added later inherit them
+		void SetItemStyles(const ItemStyles& styles);
+
+		// return colors of rows
+		const ItemStyles& GetItemStyles() const;
+
+		// return menu items published last
+		std::vector<std::shared_ptr<MenuItem>> GetItems() const;
+
+		// apply changes made by function as one update, readers see all of them or none
+		// calls may be nested, changes are published when the outer one returns
+		void Batch(const std::function<void()>& changes);
+
+		// replace items by items of source while menu may be executed
+		// items are matched by stable id, matched nodes are kept with their callbacks and settings
+		// and get children of their counterparts, so navigation path and selection survive
+		// only rows which changed are repainted
+		void Reload(const MenuNode& source);
+
+		// build tree on background thread and reload from it
+		// future is ready when tree is reloaded or skipped since newer tree was reloaded first or node was destroyed
+		// discarded future does not block, node does not wait for builder when it is destroyed
+		std::future<void> ReloadAsync(std::function<std::shared_ptr<MenuNode>()> builder);
+
+		// index items below this node by path of captions starting with caption of this node
+		// items added later are indexed as they are added and removed ones as they are purged
+		void EnableIndex();
+
+		// return item at path, children of nodes created on demand are created along the path
+		// separator in caption is escaped in path, see PathIndex
+		// return nullptr if path is not found or index is not enabled
+		std::shared_ptr<MenuItem> FindPath(const tstring& path);
+
+		// return paths starting with prefix and their items, nodes created on demand are not expanded
+		std::vector<std::pair<tstring, std::shared_ptr<MenuItem>>> EnumeratePaths(const tstring& prefix);
+
+		// call menu and enter nodes on path as if they were chosen by keys, callback of the last item is run
+		// back key returns through the nodes on path, return false if path is not found
+		bool ExecuteAt(const tstring& path);
+
+		// create children of node made on demand, regular node has them already
+		virtual void Expand() {};
 
 		// set maximum visible menu items in node
 		// this one do not change recursively this parameter 
@@ -333,6 +746,12 @@ namespace Menu
 		// return maximum visible menu items count
 		size_t GetMaxVisibleMenuItems() const;
 
+		// set position of selected item in window of visible items
+		void SetVisibleScrollPolicy(VisibleScrollPolicy policy);
+
+		// return position of selected item in window of visible items
+		VisibleScrollPolicy GetVisibleScrollPolicy() const;
+
 		// return mutable selected item
 		std::shared_ptr<MenuItem> GetSelectedItem();
 
@@ -342,32 +761,109 @@ namespace Menu
 		//
 		void AddFrame(std::shared_ptr<MenuFrame> frame);
 
+		// place frames of layout below menu items, frames are added to node if needed
+		// layout is rearranged when console is resized
+		void SetLayout(std::shared_ptr<Layout> layout);
+
 	private:
 
+		// frames placement
+		std::shared_ptr<Layout> _layout;
+
+		// console geometry generation of the last arrangement
+		uint32_t _layoutGeneration{ 0u };
+
+		// arrange layout for current console size, return moved frames
+		std::vector<std::shared_ptr<MenuFrame>> Relayout();
+
+		// refresh console geometry and repaint what it affects
+		void OnResize();
+
 		// vector of frames
 		std::vector<std::shared_ptr<MenuFrame>> _menuFrames;
 
-		// vector of menu items
-		std::vector<std::shared_ptr<MenuItem>> _menuItems;
+		// list of menu items, copy of snapshot shares chunks of it
+		using Items = ChunkedList<std::shared_ptr<MenuItem>>;
+
+		// Items are published as immutable snapshots, readers load the current one
+		// without locks and keep it alive while they use it.
+		// Writers copy the snapshot, change the copy and publish it.
+		struct Snapshot
+		{
+			// menu items
+			Items items;
+
+			// map of hotkeys of the current policy
+			std::map<size_t, std::weak_ptr<MenuItem>> hotkeys;
 
-		// map of hotkeys
-		std::map<size_t, std::weak_ptr<MenuItem>> _hotkeys;
+			// free keys of the current policy
+			HotkeyAllocator allocator{ HotkeyAllocator::Letters() };
 
-		// list of illegal hotkey letters
-		std::list<TCHAR> _illegalList{ _T(' '), _T('/'), _T('.'), _T(',') };
+			// hotkeys of other policies, restored when policy is switched back
+			std::map<HotkeyPolicy, std::map<size_t, std::weak_ptr<MenuItem>>> parked;
+
+			// length of the biggest line in menu items
+			size_t hotkeyOffset{ 0u };
+		};
+
+		// snapshot read by drawing and navigation, accessed by atomic_load and atomic_store
+		std::shared_ptr<const Snapshot> _snapshot{ std::make_shared<Snapshot>() };
+
+		// serializes writers
+		std::recursive_mutex _writeMutex;
+
+		// copy changed by the current batch, nullptr outside of batch
+		std::shared_ptr<Snapshot> _pending;
+
+		// depth of nested batches
+		size_t _batchDepth{ 0u };
+
+		// node as seen by threads of ReloadAsync, reset by d-tor
+		struct ReloadTarget
+		{
+			std::mutex mutex;
+			MenuNode* node{ nullptr };
+
+			// generations of the last requested and the last reloaded tree
+			uint64_t requested{ 0u };
+			uint64_t reloaded{ 0u };
+		};
+
+		std::shared_ptr<ReloadTarget> _reloadTarget{ std::make_shared<ReloadTarget>() };
+
+		// return the current snapshot
+		std::shared_ptr<const Snapshot> GetSnapshot() const;
+
+		// change copy of snapshot and publish it unless batch is open
+		void Mutate(const std::function<void(Snapshot&)>& change);
+
+		// make pending copy the current snapshot, writer lock is held
+		void Publish();
+
+		// publish items without ones marked as deleted, return true if any was removed
+		bool PurgeDeleted();
 
 		//
-		HotkeyPolicy _hkpolicy{ HotkeyPolicy::hp_letters };
+		std::atomic<HotkeyPolicy> _hkpolicy{ HotkeyPolicy::hp_letters };
 
 		//
 		VisibleScrollPolicy _vsp{ VisibleScrollPolicy::vsp_center };
 
-		// length of the biggest line in menu items
-		size_t _hotkeyOffset{ 0u };
+		// colors of rows
+		ItemStyles _itemStyles;
 
 		// maximum visible menu items
 		size_t _maxVisibleItems{ 3u };
 
+		// position of selected item, checked before use since items may be selected directly
+		std::atomic<size_t> _selectedHint{ 0u };
+
+		// count of selections when selected item was the only one, hint is searched again when it changes
+		std::atomic<uint64_t> _selectionsSeen{ 0u };
+
+		// count of deletions when deleted items were purged, guarded by draw mutex
+		uint64_t _purgedDeletions{ 0u };
+
 		//
 		void OnBack();
 
@@ -378,17 +874,40 @@ namespace Menu
 		void SetFirtsSelected();
 		void SetLastSelected();
 
+		// move selection by count of items, selection stops at the first and the last one
+		void MoveSelected(ptrdiff_t count);
+
 		// return selected menu iterator on success or end on failure
-		std::vector<std::shared_ptr<MenuItem>>::iterator GetSelectedMenuIterator();
+		static Items::const_iterator GetSelectedMenuIterator(const Items& items);
+
+		// return position of selected item or count of items if none is selected
+		// constant time when no item was selected since selection was resolved or changed by node,
+		// otherwise items are searched and all but the first selected one are released
+		size_t ResolveSelected(const Items& items);
+
+		// release selected item and select item at position
+		void SelectAt(const Items& items, size_t position);
 
-		void AssignHotkey(std::reference_wrapper<std::shared_ptr<MenuItem>> item);
+		// return position of the first item of window showing selected one
+		size_t GetWindowFirst(size_t selected, size_t count) const;
 
-		bool IsHotkeyAvailable(size_t hotkey);
+		// append item to the list of snapshot without hotkey
+		void Insert(Snapshot& state, std::shared_ptr<MenuItem> node);
 
-		bool IsHotKeyInUse(size_t hotkey);
+		// take key for item by policy, item keeps its hotkey if no key is free
+		void AssignHotkey(Snapshot& state, const std::shared_ptr<MenuItem>& item);
 
-		// clear screen and draw menu items
-		void Draw();
+		// free keys of removed and deleted items
+		static void ReleaseHotkeys(Snapshot& state);
+
+		// allocator of key space of policy
+		static HotkeyAllocator GetAllocator(HotkeyPolicy policy);
+
+		// value shown to user for key, numbers and Fx keys are shown shifted by one
+		static size_t GetHotkeyLabel(HotkeyPolicy policy, size_t key);
+
+		// clear screen and draw menu items, frames are updated if draw_frames
+		void Draw(bool draw_frames = true);
 
 		// run callback if it is available and draw menu items
 		void OnEnter();
@@ -397,7 +916,71 @@ namespace Menu
 		void ProcessHotKey(int32_t code);
 
 		// true if node is processing keys input
-		bool _isProcessing{ false };
+		std::atomic<bool> _isProcessing{ false };
+
+		// index of tree and path of this node, guarded by writer lock
+		std::shared_ptr<PathIndex> _index;
+		tstring _path;
+
+		// item entered by the next Execute before keys are processed
+		// set by thread of ExecuteAt while node may be executed, accessed by atomic_store and atomic_exchange
+		std::shared_ptr<MenuItem> _entering;
+
+		// clear item entered by this node and by nodes below it
+		void DropEntering();
+
+		// return index and path of this node
+		std::shared_ptr<PathIndex> GetIndex(tstring& path);
+
+		// set index and add children to it, writer lock of parent is held
+		void SetIndex(std::shared_ptr<PathIndex> index, const tstring& path);
+
+		// add item and items below it to index, writer lock is held
+		void Attach(const std::shared_ptr<MenuItem>& item);
+
+		// remove item and items below it from index, writer lock is held
+		void Detach(const std::shared_ptr<MenuItem>& item);
+
+		// add paths below this node starting with path to list
+		void CollectPaths(const tstring& path, std::vector<std::pair<tstring, std::shared_ptr<MenuItem>>>& paths);
+
+		// the last query searched in frames
+		tstring _lastQuery;
+
+		// index of frame scrolled by keys
+		size_t _activeFrame{ 0u };
+
+		// return frame scrolled by keys or nullptr
+		std::shared_ptr<MenuFrame> GetActiveFrame() const;
+
+		// make the next visible frame active
+		void SetNextActiveFrame();
+
+		// counters of UI shown by Ctrl+G, created on the first use
+		std::shared_ptr<MetricsFrame> _metricsFrame;
+
+		// show or hide metrics frame
+		void ToggleMetrics();
+
+		// read query and show next matching line in every visible frame
+		void Search();
+
+		// read number of item and select it
+		void JumpToIndex();
+
+		// print text on the line below menu items
+		void PrintPrompt(const tstring & text) const;
+
+		// rows of menu items and prompt drawn last time, guarded by console lock
+		mutable std::vector<StyledText> _rows;
+		mutable tstring _prompt;
+
+		// print menu rows, console is locked
+		// rows equal to drawn ones are skipped, all rows are printed if drawn is nullptr
+		void PrintRows(const std::vector<StyledText>* drawn = nullptr) const;
+
+		// repaint menu rows, console is locked
+		void Recompose() override;
 
 		//
 		void ClearFrameOnScreen();
@@ -422,15 +1005,99 @@ namespace Menu
 		// clear screen or part of it
 		void Clear() const;
 
+		// returned by GetKey when console was resized
+		static const unsigned short ResizeKey{ 0xFFFF };
+
 		// blocking function that await key input
-		// return key code
+		// return key code or ResizeKey
 		static unsigned short GetKey();
 
 		// execute key processing
 		void ProcessKey();
 
-		// draw single menu item
-		void PrintMenuItem(const std::shared_ptr<MenuItem>& item) const;
+		// return row of single menu item
+		// width of row is summed from cached widths of its parts
+		StyledText FormatMenuItem(const std::shared_ptr<MenuItem>& item, size_t hotkeyOffset, size_t& width) const;
+	};
+
+	// menu node which children are produced by generator on the first enter
+	class LazyMenuNode : public MenuNode
+	{
+	public:
+
+		using Generator = std::function<std::vector<std::shared_ptr<MenuItem>>()>;
+
+		// c-tor
+		LazyMenuNode(const tstring &caption, Generator generator);
+
+		// v d-tor
+		virtual ~LazyMenuNode() = default;
+
+		// materialize children if needed and call menu
+		void Execute() override;
+
+		// materialize children if they are not materialized or expired
+		void Expand() override;
+
+		// start generating children in background if they are not materialized yet
+		// generator runs on detached thread, destruction of node does not wait for it, captures of generator have to outlive it
+		void Prefetch() override;
+
+		// set time after which materialized children are regenerated, zero - never
+		void SetTimeToLive(std::chrono::milliseconds ttl);
+
+		// drop cached children and pending prefetch, they will be regenerated on the next enter
+		void Invalidate();
+
+		// return true if children are generated and not expired
+		bool IsMaterialized() const;
+
+	protected:
+
+		// replace children with generated ones, called inside of batch
+		virtual void Install(std::vector<std::shared_ptr<MenuItem>> items);
+
+	private:
+
+		// children generated in background, shared with generating thread
+		struct Prefetched
+		{
+			std::mutex mutex;
+			std::condition_variable condition;
+			bool ready{ false };
+			std::vector<std::shared_ptr<MenuItem>> items;
+			std::exception_ptr error;
+		};
+
+		// children generator
+		Generator _generator;
+
+		// guards fields below, it is not held while generator runs
+		mutable std::mutex _lazyMutex;
+
+		// serializes materialization, children are generated once for concurrent enters
+		std::mutex _expandMutex;
+
+		// children lifetime, zero - never expire
+		std::chrono::milliseconds _ttl{ 0 };
+
+		// time of the last materialization
+		std::chrono::steady_clock::time_point _materializedAt;
+
+		// true if children are generated
+		bool _materialized{ false };
+
+		// incremented by invalidation, children generated before it are not marked as materialized
+		uint64_t _generation{ 0u };
+
+		// pending prefetch, dropped by invalidation
+		std::shared_ptr<Prefetched> _prefetched;
+
+		// return true if children are generated and not expired, _lazyMutex is held
+		bool IsMaterializedLocked() const;
+
+		// replace children with generated ones
+		void Materialize();
 	};
 
 }
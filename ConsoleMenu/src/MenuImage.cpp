@@ -0,0 +1,309 @@
+#include "MenuImage.h"
+
+#include <queue>
+#include <cassert>
+
+namespace Menu {
+
+	namespace
+	{
+		const uint32_t ImageMagic{ 0x4D494D43u }; // "CMIM"
+
+		bool WriteBlock(HANDLE file, const void* data, size_t size)
+		{
+			auto ptr = static_cast<const uint8_t*>(data);
+			while (size)
+			{
+				DWORD chunk = size > 0x10000000u ? 0x10000000u : static_cast<DWORD>(size);
+				DWORD written = 0;
+				if (WriteFile(file, ptr, chunk, &written, nullptr) == 0 || written == 0)
+					return false;
+				ptr += written;
+				size -= written;
+			}
+			return true;
+		}
+	}
+
+	struct MenuImage::Mapping
+	{
+		HANDLE file{ INVALID_HANDLE_VALUE };
+		HANDLE map{ nullptr };
+		const uint8_t* base{ nullptr };
+		uint64_t size{ 0u };
+
+		~Mapping()
+		{
+			if (base)
+				UnmapViewOfFile(base);
+			if (map)
+				CloseHandle(map);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+		}
+
+		const Header& GetHeader() const
+		{
+			return *reinterpret_cast<const Header*>(base);
+		}
+
+		const Record& GetRecord(size_t index) const
+		{
+			return reinterpret_cast<const Record*>(base + sizeof(Header))[index];
+		}
+
+		const TCHAR* GetString(uint32_t offset) const
+		{
+			return reinterpret_cast<const TCHAR*>(base + GetHeader().stringsOffset) + offset;
+		}
+	};
+
+	class MenuImage::ImageNode : public LazyMenuNode
+	{
+	public:
+
+		ImageNode(const tstring& caption, Generator generator, std::shared_ptr<Mapping> mapping, size_t index)
+			:LazyMenuNode(caption, generator), _mapping(mapping), _index(index)
+		{
+		}
+
+	protected:
+
+		void Install(std::vector<std::shared_ptr<MenuItem>> items) override
+		{
+			auto& parent = _mapping->GetRecord(_index);
+
+			// items are generated in order of records
+			Reset();
+			for (size_t i = 0u; i < items.size(); ++i)
+				Add(std::move(items[i]), _mapping->GetRecord(parent.firstChild + i).hotkey);
+		}
+
+	private:
+
+		std::shared_ptr<Mapping> _mapping;
+		size_t _index;
+	};
+
+	MenuImage::~MenuImage()
+	{
+		Close();
+	}
+
+	bool MenuImage::Write(MenuNode& root, const tstring& path)
+	{
+		std::vector<Record> records;
+		std::vector<TCHAR> strings;
+
+		// breadth-first traversal keeps children of every node contiguous
+		std::queue<MenuItem*> pending;
+
+		auto append = [&](MenuItem* item, const MenuNode* parent)
+		{
+			Record record{};
+			record.captionOffset = static_cast<uint32_t>(strings.size());
+			record.captionLength = static_cast<uint32_t>(item->GetCaption().size());
+			record.hotkey = parent ? static_cast<uint32_t>(parent->GetHotkeyCode(item)) : 0u;
+			record.callbackId = item->GetCallbackId();
+
+			auto node = dynamic_cast<const MenuNode*>(item);
+			if (node)
+			{
+				record.isNode = 1u;
+				record.policy = static_cast<uint8_t>(node->GetPolicy());
+				record.maxVisibleItems = static_cast<uint32_t>(node->GetMaxVisibleMenuItems());
+			}
+
+			strings.insert(strings.end(), item->GetCaption().begin(), item->GetCaption().end());
+			records.emplace_back(record);
+			pending.push(item);
+		};
+
+		append(&root, nullptr);
+
+		for (size_t index = 0u; !pending.empty(); ++index)
+		{
+			auto node = dynamic_cast<MenuNode*>(pending.front());
+			pending.pop();
+
+			if (node == nullptr)
+				continue;
+
+			// children of nodes created on demand are stored too
+			node->Expand();
+
+			// one snapshot, items may change meanwhile
+			auto items = node->GetItems();
+
+			records[index].firstChild = static_cast<uint32_t>(records.size());
+			records[index].childCount = static_cast<uint32_t>(items.size());
+
+			for (auto&& item : items)
+				append(item.get(), node);
+		}
+
+		Header header{};
+		header.magic = ImageMagic;
+		header.version = Version;
+		header.charSize = sizeof(TCHAR);
+		header.recordCount = static_cast<uint32_t>(records.size());
+		header.stringsOffset = sizeof(Header) + records.size() * sizeof(Record);
+		header.stringsSize = strings.size();
+
+		auto file = CreateFile(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		auto result = WriteBlock(file, &header, sizeof(header))
+			&& WriteBlock(file, records.data(), records.size() * sizeof(Record))
+			&& WriteBlock(file, strings.data(), strings.size() * sizeof(TCHAR));
+
+		CloseHandle(file);
+		return result;
+	}
+
+	bool MenuImage::Open(const tstring& path)
+	{
+		Close();
+
+		auto mapping = std::make_shared<Mapping>();
+
+		mapping->file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (mapping->file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(mapping->file, &size) == 0 || static_cast<uint64_t>(size.QuadPart) < sizeof(Header))
+			return false;
+
+		mapping->size = size.QuadPart;
+
+		mapping->map = CreateFileMapping(mapping->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping->map == nullptr)
+			return false;
+
+		mapping->base = static_cast<const uint8_t*>(MapViewOfFile(mapping->map, FILE_MAP_READ, 0, 0, 0));
+		if (mapping->base == nullptr)
+			return false;
+
+		// validate format before any navigation
+		auto& header = mapping->GetHeader();
+		if (header.magic != ImageMagic || header.version != Version || header.charSize != sizeof(TCHAR) || header.recordCount == 0)
+			return false;
+
+		if (header.stringsOffset != sizeof(Header) + uint64_t(header.recordCount) * sizeof(Record)
+			|| header.stringsOffset > mapping->size
+			|| header.stringsSize > (mapping->size - header.stringsOffset) / sizeof(TCHAR))
+			return false;
+
+		if (!Validate(*mapping))
+			return false;
+
+		_mapping = mapping;
+		return true;
+	}
+
+	bool MenuImage::Validate(const Mapping& mapping)
+	{
+		auto& header = mapping.GetHeader();
+
+		for (size_t index = 0u; index < header.recordCount; ++index)
+		{
+			auto& record = mapping.GetRecord(index);
+
+			if (uint64_t(record.captionOffset) + record.captionLength > header.stringsSize)
+				return false;
+
+			if (record.policy > static_cast<uint8_t>(MenuNode::HotkeyPolicy::hp_fx_keys))
+				return false;
+
+			if (!record.isNode)
+			{
+				if (record.childCount != 0u)
+					return false;
+				continue;
+			}
+
+			// children follow their parent, so nodes can not form a cycle
+			if (record.childCount != 0u && (record.firstChild <= index || uint64_t(record.firstChild) + record.childCount > header.recordCount))
+				return false;
+		}
+		return true;
+	}
+
+	void MenuImage::Close()
+	{
+		_mapping.reset();
+	}
+
+	bool MenuImage::IsOpen() const
+	{
+		return _mapping != nullptr;
+	}
+
+	size_t MenuImage::GetCount() const
+	{
+		return _mapping ? _mapping->GetHeader().recordCount : 0u;
+	}
+
+	const MenuImage::Record& MenuImage::GetRecord(size_t index) const
+	{
+		assert(index < GetCount());
+		return _mapping->GetRecord(index);
+	}
+
+	const TCHAR* MenuImage::GetCaption(size_t index) const
+	{
+		return _mapping->GetString(GetRecord(index).captionOffset);
+	}
+
+	std::shared_ptr<MenuNode> MenuImage::Load(const CallbackTable& callbacks) const
+	{
+		if (!_mapping)
+			return nullptr;
+
+		return std::dynamic_pointer_cast<MenuNode>(Create(_mapping, 0u, std::make_shared<CallbackTable>(callbacks)));
+	}
+
+	std::shared_ptr<MenuItem> MenuImage::Create(const std::shared_ptr<Mapping>& mapping, size_t index, const std::shared_ptr<CallbackTable>& callbacks)
+	{
+		auto& record = mapping->GetRecord(index);
+		tstring caption(mapping->GetString(record.captionOffset), record.captionLength);
+
+		std::shared_ptr<MenuItem> item;
+
+		if (record.isNode)
+		{
+			// children are read from the mapped image only when node is entered
+			auto node = std::make_shared<ImageNode>(caption, [mapping, index, callbacks]()
+			{
+				auto& parent = mapping->GetRecord(index);
+
+				std::vector<std::shared_ptr<MenuItem>> items;
+				items.reserve(parent.childCount);
+
+				for (auto child = parent.firstChild; child < parent.firstChild + parent.childCount; ++child)
+					items.emplace_back(Create(mapping, child, callbacks));
+
+				return items;
+			}, mapping, index);
+
+			// stored hotkeys are taken from allocator of policy
+			node->SetPolicy(static_cast<MenuNode::HotkeyPolicy>(record.policy));
+			node->SetMaxVisibleMenuItems(record.maxVisibleItems);
+			item = node;
+		}
+		else
+		{
+			item = std::make_shared<MenuItem>(caption);
+		}
+
+		item->SetCallbackId(record.callbackId);
+
+		auto callback = callbacks->find(record.callbackId);
+		if (record.callbackId && callback != callbacks->end())
+			item->Connect(callback->second);
+
+		return item;
+	}
+}
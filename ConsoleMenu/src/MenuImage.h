@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Menu.h"
+
+#include <unordered_map>
+#include <cstdint>
+
+namespace Menu
+{
+	// Compact read-only image of menu tree.
+	// Layout: header, records in breadth-first order (children of a node are contiguous),
+	// string pool with captions. All references are indexes or offsets, so image
+	// can be memory mapped at any address and navigated without deserializing.
+	class MenuImage
+	{
+	public:
+
+		// callbacks to rebind by MenuItem::GetCallbackId()
+		using CallbackTable = std::unordered_map<uint32_t, std::function<bool()>>;
+
+		// image format version
+		static const uint32_t Version{ 2u };
+
+#pragma pack(push, 1)
+		struct Header
+		{
+			// "CMIM"
+			uint32_t magic;
+			uint32_t version;
+			// sizeof(TCHAR) used to write captions
+			uint32_t charSize;
+			uint32_t recordCount;
+			// offset of string pool from the beginning of image
+			uint64_t stringsOffset;
+			// size of string pool in characters
+			uint64_t stringsSize;
+		};
+
+		struct Record
+		{
+			// caption position in string pool
+			uint32_t captionOffset;
+			uint32_t captionLength;
+			// index of the first child record
+			uint32_t firstChild;
+			uint32_t childCount;
+			// hotkey code in parent node, 0 - none
+			uint32_t hotkey;
+			uint32_t callbackId;
+			uint32_t maxVisibleItems;
+			// 1 if record is a MenuNode
+			uint8_t isNode;
+			// MenuNode::HotkeyPolicy
+			uint8_t policy;
+			uint16_t reserved;
+		};
+#pragma pack(pop)
+
+		// c-tor
+		MenuImage() = default;
+
+		// d-tor
+		~MenuImage();
+
+		MenuImage(const MenuImage&) = delete;
+		MenuImage& operator=(const MenuImage&) = delete;
+
+		// serialize menu tree into image file, nodes created on demand are expanded
+		// return false on failure
+		static bool Write(MenuNode& root, const tstring& path);
+
+		// map image file read-only and validate every record
+		// return false if file is missing, has incompatible format or is damaged
+		bool Open(const tstring& path);
+
+		// unmap image, nodes loaded from it keep mapping alive
+		void Close();
+
+		// return true if image is mapped
+		bool IsOpen() const;
+
+		// return count of records, 0 is the root
+		size_t GetCount() const;
+
+		// return record by index
+		const Record& GetRecord(size_t index) const;
+
+		// return caption of record without copying it
+		const TCHAR* GetCaption(size_t index) const;
+
+		// build root node, nested nodes are materialized lazily from the mapped image
+		std::shared_ptr<MenuNode> Load(const CallbackTable& callbacks) const;
+
+	private:
+
+		// mapped view shared with loaded nodes
+		struct Mapping;
+
+		// node which adds children with hotkeys stored in image
+		class ImageNode;
+
+		std::shared_ptr<Mapping> _mapping;
+
+		// return true if records and strings of mapped image are consistent
+		static bool Validate(const Mapping& mapping);
+
+		// create node or item for record
+		static std::shared_ptr<MenuItem> Create(const std::shared_ptr<Mapping>& mapping, size_t index, const std::shared_ptr<CallbackTable>& callbacks);
+	};
+}
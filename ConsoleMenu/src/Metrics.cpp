@@ -0,0 +1,226 @@
+#include "Metrics.h"
+#include "Trace.h"
+
+namespace Menu {
+
+	namespace
+	{
+		const size_t ShardCount{ 32u };
+
+		// counters of threads sharing shard, shards do not share cache lines
+		struct alignas(64) Shard
+		{
+			std::atomic<uint64_t> values[size_t(Metric::m_count)];
+		};
+
+		// zero initialized before any thread starts
+		Shard shards[ShardCount];
+
+		std::atomic<size_t> nextShard{ 0u };
+
+		std::atomic<bool> enabled{ true };
+
+		// shortest wait for lock recorded by trace
+		const std::chrono::microseconds TracedWait{ 1 };
+
+		const char* const Names[] =
+		{
+			"repaints",
+			"cells_written",
+			"bytes_written",
+			"lines_ingested",
+			"lines_dropped",
+			"spill_failures",
+			"callbacks",
+			"callback_time_ns",
+			"console_locks",
+			"console_lock_wait_ns",
+			"console_lock_hold_ns",
+			"draw_locks",
+			"draw_lock_wait_ns",
+			"draw_lock_hold_ns",
+		};
+
+		static_assert(sizeof(Names) / sizeof(Names[0]) == size_t(Metric::m_count), "every metric has name");
+
+		// shard of calling thread, threads are spread round robin
+		Shard& ThisShard()
+		{
+			thread_local size_t shard = nextShard++ % ShardCount;
+			return shards[shard];
+		}
+
+		uint64_t Elapsed(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+		}
+	}
+
+	const Metrics::LockMetrics Metrics::ConsoleLock{ "wait console lock", Metric::m_console_locks, Metric::m_console_lock_wait, Metric::m_console_lock_hold };
+	const Metrics::LockMetrics Metrics::DrawLock{ "wait draw lock", Metric::m_draw_locks, Metric::m_draw_lock_wait, Metric::m_draw_lock_hold };
+
+	void Metrics::Add(Metric metric, uint64_t value)
+	{
+		if (enabled.load(std::memory_order_relaxed))
+			ThisShard().values[size_t(metric)].fetch_add(value, std::memory_order_relaxed);
+	}
+
+	Metrics::Snapshot Metrics::Take()
+	{
+		Snapshot snapshot;
+		snapshot.time = std::chrono::steady_clock::now();
+
+		for (size_t i = 0u; i < size_t(Metric::m_count); ++i)
+		{
+			uint64_t sum = 0u;
+			for (auto&& shard : shards)
+				sum += shard.values[i].load(std::memory_order_relaxed);
+			snapshot.values[i] = sum;
+		}
+		return snapshot;
+	}
+
+	const char* Metrics::GetName(Metric metric)
+	{
+		return metric < Metric::m_count ? Names[size_t(metric)] : "";
+	}
+
+	void Metrics::SetEnabled(bool enable)
+	{
+		enabled = enable;
+	}
+
+	bool Metrics::IsEnabled()
+	{
+		return enabled;
+	}
+
+	MeteredLock::MeteredLock(std::mutex& mutex, const Metrics::LockMetrics& metrics) :_lock(mutex, std::defer_lock), _metrics(metrics)
+	{
+		auto traced = Trace::IsEnabled();
+		if (!Metrics::IsEnabled() && !traced)
+		{
+			_lock.lock();
+			return;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		_lock.lock();
+		_locked = std::chrono::steady_clock::now();
+
+		// uncontended locks would fill trace buffers
+		if (traced && _locked - start >= TracedWait)
+			Trace::Record(_metrics.name, "lock", start, _locked);
+
+		if (Metrics::IsEnabled())
+		{
+			_timed = true;
+			Metrics::Add(_metrics.count);
+			Metrics::Add(_metrics.wait, Elapsed(start, _locked));
+		}
+	}
+
+	MeteredLock::MeteredLock(std::mutex& mutex, const Metrics::LockMetrics& metrics, std::try_to_lock_t) :_lock(mutex, std::try_to_lock), _metrics(metrics)
+	{
+		if (_lock.owns_lock() && Metrics::IsEnabled())
+		{
+			_locked = std::chrono::steady_clock::now();
+			_timed = true;
+			Metrics::Add(_metrics.count);
+		}
+	}
+
+	MeteredLock::~MeteredLock()
+	{
+		if (_timed)
+			Metrics::Add(_metrics.hold, Elapsed(_locked, std::chrono::steady_clock::now()));
+	}
+
+	MetricsExporter::MetricsExporter(const tstring& path, std::chrono::milliseconds interval) :_path(path), _interval(interval)
+	{
+	}
+
+	MetricsExporter::~MetricsExporter()
+	{
+		Stop();
+	}
+
+	bool MetricsExporter::Start()
+	{
+		Stop();
+
+		{
+			std::lock_guard<std::mutex> lk(_fileMutex);
+
+			_file = CreateFile(_path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (_file == INVALID_HANDLE_VALUE)
+				return false;
+
+			// new file starts with names of columns
+			if (GetLastError() != ERROR_ALREADY_EXISTS)
+			{
+				std::string header = "time_ms";
+				for (size_t i = 0u; i < size_t(Metric::m_count); ++i)
+					header.append(",").append(Metrics::GetName(Metric(i)));
+				header += "\n";
+
+				DWORD written = 0;
+				WriteFile(_file, header.data(), static_cast<DWORD>(header.size()), &written, nullptr);
+			}
+		}
+
+		_running = true;
+		_thread = std::thread([this]()
+		{
+			std::unique_lock<std::mutex> lk(_mutex);
+			while (_running)
+			{
+				_condition.wait_for(lk, _interval, [this]() { return !_running; });
+
+				lk.unlock();
+				WriteRow();
+				lk.lock();
+			}
+		});
+		return true;
+	}
+
+	void MetricsExporter::Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lk(_mutex);
+			_running = false;
+		}
+		_condition.notify_all();
+
+		if (_thread.joinable())
+			_thread.join();
+
+		std::lock_guard<std::mutex> lk(_fileMutex);
+		if (_file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(_file);
+			_file = INVALID_HANDLE_VALUE;
+		}
+	}
+
+	bool MetricsExporter::WriteRow()
+	{
+		auto snapshot = Metrics::Take();
+
+		// wall clock lets rows be matched with other logs
+		auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+		auto row = std::to_string(now);
+		for (auto value : snapshot.values)
+			row.append(",").append(std::to_string(value));
+		row += "\n";
+
+		std::lock_guard<std::mutex> lk(_fileMutex);
+		if (_file == INVALID_HANDLE_VALUE)
+			return false;
+
+		DWORD written = 0;
+		return WriteFile(_file, row.data(), static_cast<DWORD>(row.size()), &written, nullptr) != 0 && written == row.size();
+	}
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <windows.h>
+#include <TCHAR.h>
+
+namespace Menu
+{
+	// counters of UI layer, times are in nanoseconds
+	enum class Metric : uint8_t
+	{
+		m_repaints,
+		m_cells_written,
+		m_bytes_written,
+		m_lines_ingested,
+		m_lines_dropped,
+		// writes of scrollback segment file which failed, lines stay in memory
+		m_spill_failures,
+		m_callbacks,
+		m_callback_time,
+		m_console_locks,
+		m_console_lock_wait,
+		m_console_lock_hold,
+		m_draw_locks,
+		m_draw_lock_wait,
+		m_draw_lock_hold,
+		// count of metrics
+		m_count,
+	};
+
+	// Registry of counters.
+	// Counters are sharded by thread, increment is relaxed add to a cache line used by few threads.
+	// Snapshot sums shards, it is not synchronized with increments.
+	class Metrics
+	{
+	public:
+
+		// counters of lock, name of lock is shown by trace
+		struct LockMetrics
+		{
+			const char* name;
+			Metric count;
+			Metric wait;
+			Metric hold;
+		};
+
+		// global_set_pos_mutex and MenuNode::_drawMutex
+		static const LockMetrics ConsoleLock;
+		static const LockMetrics DrawLock;
+
+		// values of all counters at time
+		struct Snapshot
+		{
+			std::chrono::steady_clock::time_point time;
+			uint64_t values[size_t(Metric::m_count)];
+
+			uint64_t operator[](Metric metric) const { return values[size_t(metric)]; }
+		};
+
+		// add value to counter
+		static void Add(Metric metric, uint64_t value = 1u);
+
+		// return sums of counters
+		static Snapshot Take();
+
+		// return name of counter
+		static const char* GetName(Metric metric);
+
+		// switch counting, timers are not read when disabled
+		static void SetEnabled(bool enabled);
+		static bool IsEnabled();
+	};
+
+	// Lock of mutex counting locks, time of waiting and holding.
+	class MeteredLock
+	{
+	public:
+
+		// c-tor, locks mutex
+		MeteredLock(std::mutex& mutex, const Metrics::LockMetrics& metrics);
+
+		// c-tor, tries to lock mutex
+		MeteredLock(std::mutex& mutex, const Metrics::LockMetrics& metrics, std::try_to_lock_t);
+
+		// d-tor, unlocks mutex if it is owned
+		~MeteredLock();
+
+		MeteredLock(const MeteredLock&) = delete;
+		MeteredLock& operator=(const MeteredLock&) = delete;
+
+		// return true if mutex is locked
+		bool owns_lock() const { return _lock.owns_lock(); }
+
+	private:
+
+		std::unique_lock<std::mutex> _lock;
+		const Metrics::LockMetrics& _metrics;
+
+		// moment mutex was locked, not set if metrics are disabled
+		std::chrono::steady_clock::time_point _locked;
+		bool _timed{ false };
+	};
+
+	// Writer of snapshots to csv file, a row per interval.
+	class MetricsExporter
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+
+		// c-tor
+		MetricsExporter(const tstring& path, std::chrono::milliseconds interval);
+
+		// d-tor, stops writing
+		~MetricsExporter();
+
+		// open file and start writing on background thread, rows are appended to existing file
+		// return false if file can not be opened
+		bool Start();
+
+		// write the last row and close file
+		void Stop();
+
+		// write row now, return false on failure
+		bool WriteRow();
+
+	private:
+
+		tstring _path;
+		std::chrono::milliseconds _interval;
+
+		HANDLE _file{ INVALID_HANDLE_VALUE };
+
+		// guards file
+		std::mutex _fileMutex;
+
+		std::thread _thread;
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		bool _running{ false };
+	};
+}
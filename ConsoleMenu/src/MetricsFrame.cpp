@@ -0,0 +1,104 @@
+#include "MetricsFrame.h"
+
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+namespace Menu {
+
+	namespace
+	{
+		// counter and counter of events it is measured for, average time is shown for such pairs
+		struct Row
+		{
+			Metric metric;
+			Metric per;
+		};
+
+		const Row Rows[] =
+		{
+			{ Metric::m_repaints, Metric::m_count },
+			{ Metric::m_cells_written, Metric::m_count },
+			{ Metric::m_bytes_written, Metric::m_count },
+			{ Metric::m_lines_ingested, Metric::m_count },
+			{ Metric::m_lines_dropped, Metric::m_count },
+			{ Metric::m_spill_failures, Metric::m_count },
+			{ Metric::m_callbacks, Metric::m_count },
+			{ Metric::m_callback_time, Metric::m_callbacks },
+			{ Metric::m_console_locks, Metric::m_count },
+			{ Metric::m_console_lock_wait, Metric::m_console_locks },
+			{ Metric::m_console_lock_hold, Metric::m_console_locks },
+			{ Metric::m_draw_locks, Metric::m_count },
+			{ Metric::m_draw_lock_wait, Metric::m_draw_locks },
+			{ Metric::m_draw_lock_hold, Metric::m_draw_locks },
+		};
+
+		// averages are shown in microseconds instead of total nanoseconds
+		tstring Name(const Row& row)
+		{
+			auto name = Metrics::GetName(row.metric);
+			auto length = std::strlen(name);
+			if (row.per == Metric::m_count)
+				return tstring(name, name + length);
+
+			return tstring(name, name + length - (length > 3 ? 3 : 0)) + _T("_avg");
+		}
+	}
+
+	MetricsFrame::MetricsFrame() :StatusFrame(_T("Metrics"))
+	{
+		// rows are ready before the first sample
+		for (auto&& row : Rows)
+			Set(Name(row), _T("-"));
+	}
+
+	MetricsFrame::~MetricsFrame()
+	{
+		StopPolling();
+	}
+
+	size_t MetricsFrame::GetRowCount()
+	{
+		return sizeof(Rows) / sizeof(Rows[0]);
+	}
+
+	void MetricsFrame::Poll()
+	{
+		auto sample = Metrics::Take();
+
+		auto seconds = _sampled ? std::chrono::duration<double>(sample.time - _last.time).count() : 0.0;
+
+		std::vector<std::pair<tstring, tstring>> values;
+		for (auto&& row : Rows)
+		{
+			std::basic_ostringstream<TCHAR> text;
+			text << std::fixed << std::setprecision(1);
+
+			auto delta = _sampled ? sample[row.metric] - _last[row.metric] : 0u;
+			if (row.per == Metric::m_count)
+			{
+				text << sample[row.metric];
+				if (seconds > 0.0)
+					text << _T(" (") << delta / seconds << _T("/s)");
+			}
+			else
+			{
+				// average of the last interval in microseconds
+				auto events = _sampled ? sample[row.per] - _last[row.per] : 0u;
+				if (events)
+					text << delta / 1000.0 / events << _T(" us");
+				else
+					text << _T("-");
+			}
+			values.emplace_back(Name(row), text.str());
+		}
+
+		_last = sample;
+		_sampled = true;
+
+		Set(values);
+
+		// getters bound by user
+		StatusFrame::Poll();
+	}
+}
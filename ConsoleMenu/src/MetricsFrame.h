@@ -0,0 +1,31 @@
+#pragma once
+
+#include "StatusFrame.h"
+#include "Metrics.h"
+
+namespace Menu
+{
+	// Frame showing counters of UI layer with their rates, built into every node and hidden until Ctrl+G.
+	class MetricsFrame : public StatusFrame
+	{
+	public:
+
+		// c-tor
+		MetricsFrame();
+
+		// d-tor, stops polling before frame is destroyed
+		virtual ~MetricsFrame();
+
+		// sample counters, show totals, rates and average times since the previous sample
+		void Poll() override;
+
+		// count of rows shown
+		static size_t GetRowCount();
+
+	private:
+
+		// previous sample
+		Metrics::Snapshot _last;
+		bool _sampled{ false };
+	};
+}
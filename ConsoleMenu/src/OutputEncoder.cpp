@@ -0,0 +1,353 @@
+#include "OutputEncoder.h"
+#include "TextWidth.h"
+
+namespace Menu {
+
+	namespace
+	{
+		using tstring = OutputEncoder::tstring;
+
+		const TCHAR* const Csi{ _T("\x1b[") };
+
+		using Text::Number;
+
+		// console color bits are blue, green, red, terminal ones are red, green, blue
+		int Ansi(WORD color)
+		{
+			return ((color & 1) << 2) | (color & 2) | ((color & 4) >> 2);
+		}
+	}
+
+	void OutputEncoder::Resize(COORD size)
+	{
+		_size.X = size.X > 0 ? size.X : 0;
+		_size.Y = size.Y > 0 ? size.Y : 0;
+
+		auto cells = size_t(_size.X) * _size.Y;
+		_shown.assign(cells, Cell{ tstring(), 0u, 1u, false });
+		_next.assign(cells, Blank());
+		_dirty.assign(_size.Y, true);
+
+		_cursor = COORD{ -1, -1 };
+		_attributesKnown = false;
+	}
+
+	void OutputEncoder::SetDefaultAttributes(WORD attributes)
+	{
+		_defaults = attributes;
+		_attributesKnown = false;
+	}
+
+	void OutputEncoder::Put(COORD coord, const tstring& text, WORD attributes)
+	{
+		if (coord.Y < 0 || coord.Y >= _size.Y || coord.X < 0)
+			return;
+
+		auto x = coord.X;
+		size_t pos = 0u;
+		while (pos < text.length() && x < _size.X)
+		{
+			// one grapheme, wide one does not fit single column
+			size_t stop = pos;
+			auto width = Text::Measure(text, pos, text.length(), 1u, &stop);
+			if (stop == pos)
+				width = Text::Measure(text, pos, text.length(), 2u, &stop);
+			if (stop == pos || x + SHORT(width) > _size.X)
+				break;
+
+			if (width == 0)
+			{
+				// marks without base join the previous grapheme, control characters are dropped
+				auto lead = x - 1;
+				if (lead >= 0 && At(_next, lead, coord.Y).width == 0)
+					--lead;
+				if (lead >= 0 && text[pos] >= _T(' '))
+					At(_next, lead, coord.Y).text.append(text, pos, stop - pos);
+				pos = stop;
+				continue;
+			}
+
+			Split(x, coord.Y);
+			if (width == 2)
+				Split(x + 1, coord.Y);
+
+			At(_next, x, coord.Y) = Cell{ text.substr(pos, stop - pos), attributes, uint8_t(width), true };
+			if (width == 2)
+				At(_next, x + 1, coord.Y) = Cell{ tstring(), attributes, 0u, true };
+
+			x += SHORT(width);
+			pos = stop;
+		}
+
+		_dirty[coord.Y] = true;
+	}
+
+	size_t OutputEncoder::Present(tcout& stream)
+	{
+		_out.clear();
+
+		for (SHORT y = 0; y < _size.Y; ++y)
+		{
+			if (_dirty[y])
+			{
+				EncodeRow(y);
+				_dirty[y] = false;
+			}
+		}
+
+		// other output may follow, it gets default colors
+		if (!_out.empty() && _attributes != _defaults)
+			SetAttributes(_defaults);
+
+		auto bytes = Bytes(_out);
+		if (bytes)
+			stream << _out;
+
+		// input echo moves cursor between frames
+		_cursor = COORD{ -1, -1 };
+
+		++_frames;
+		_totalBytes += bytes;
+		_lastFrameBytes = bytes;
+		return bytes;
+	}
+
+	void OutputEncoder::Invalidate()
+	{
+		for (auto&& cell : _shown)
+			cell.known = false;
+		_dirty.assign(_size.Y, true);
+
+		_cursor = COORD{ -1, -1 };
+		_attributesKnown = false;
+	}
+
+	OutputEncoder::Statistics OutputEncoder::GetStatistics() const
+	{
+		return Statistics{ _frames, _totalBytes, _lastFrameBytes };
+	}
+
+	OutputEncoder::Cell OutputEncoder::Blank() const
+	{
+		return Cell{ tstring(1, _T(' ')), _defaults, 1u, true };
+	}
+
+	void OutputEncoder::Split(SHORT x, SHORT y)
+	{
+		auto& cell = At(_next, x, y);
+
+		// the other half of wide grapheme becomes blank of the same colors
+		if (cell.width == 0 && x > 0)
+		{
+			auto& lead = At(_next, x - 1, y);
+			lead = Cell{ tstring(1, _T(' ')), lead.attributes, 1u, true };
+		}
+		else if (cell.width == 2 && x + 1 < _size.X)
+		{
+			auto& tail = At(_next, x + 1, y);
+			tail = Cell{ tstring(1, _T(' ')), tail.attributes, 1u, true };
+		}
+	}
+
+	void OutputEncoder::EncodeRow(SHORT y)
+	{
+		SHORT last = _size.X;
+		while (last-- > 0 && At(_next, last, y) == At(_shown, last, y));
+
+		SHORT x = 0;
+		while (x <= last)
+		{
+			if (At(_next, x, y) == At(_shown, x, y))
+			{
+				++x;
+				continue;
+			}
+
+			// wide grapheme is sent from its first column
+			if (At(_next, x, y).width == 0 && x > 0)
+				--x;
+
+			auto& cell = At(_next, x, y);
+
+			// blank rest of row is erased when it is shorter than sending cells
+			if (last - x + 1 > 3)
+			{
+				auto blank = Cell{ tstring(1, _T(' ')), cell.attributes, 1u, true };
+				auto end = x;
+				while (end < _size.X && At(_next, end, y) == blank)
+					++end;
+
+				if (end == _size.X)
+				{
+					MoveTo(x, y);
+					SetAttributes(cell.attributes);
+					_out += Csi;
+					_out += _T('K');
+
+					for (auto column = x; column < _size.X; ++column)
+						At(_shown, column, y) = blank;
+					return;
+				}
+			}
+
+			MoveTo(x, y);
+			Emit(x, y);
+
+			auto next = x + (cell.width ? cell.width : 1);
+
+			// run of the same narrow grapheme is repeated
+			if (_repeat && cell.width == 1 && _cursor.X == next)
+			{
+				auto end = next;
+				while (end < _size.X && At(_next, end, y) == cell)
+					++end;
+
+				auto count = end - next;
+				auto sequence = Csi + Number(count) + _T('b');
+				if (count > 0 && sequence.length() < count * Bytes(cell.text))
+				{
+					_out += sequence;
+					for (auto column = next; column < end; ++column)
+						At(_shown, column, y) = cell;
+
+					_cursor.X = end < _size.X ? end : -1;
+					next = end;
+				}
+			}
+
+			x = next;
+		}
+	}
+
+	void OutputEncoder::MoveTo(SHORT x, SHORT y)
+	{
+		if (_cursor.X == x && _cursor.Y == y)
+			return;
+
+		// absolute position, omitted column is the first one
+		auto best = Csi + (y || x ? Number(y + 1) : tstring()) + (x ? _T(";") + Number(x + 1) : tstring()) + _T('H');
+		auto bestBytes = best.length();
+
+		auto consider = [&](tstring&& candidate, size_t bytes)
+		{
+			if (bytes < bestBytes)
+			{
+				best = std::move(candidate);
+				bestBytes = bytes;
+			}
+		};
+
+		if (_cursor.X >= 0)
+		{
+			auto vertical = y > _cursor.Y ? Move(y - _cursor.Y, _T('B')) : Move(_cursor.Y - y, _T('A'));
+
+			if (x >= _cursor.X)
+			{
+				consider(vertical + Move(x - _cursor.X, _T('C')), vertical.length() + Move(x - _cursor.X, _T('C')).length());
+
+				// cells between are already shown, printing them again may be shorter than move
+				tstring cells;
+				auto overprint = At(_next, _cursor.X, y).width != 0;
+				for (auto column = _cursor.X; column < x && overprint; ++column)
+				{
+					auto& cell = At(_shown, column, y);
+					overprint = cell.known && cell == At(_next, column, y) && _attributesKnown && cell.attributes == _attributes;
+					cells += cell.text;
+				}
+				if (overprint)
+					consider(vertical + cells, vertical.length() + Bytes(cells));
+			}
+			else
+			{
+				consider(vertical + Move(_cursor.X - x, _T('D')), vertical.length() + Move(_cursor.X - x, _T('D')).length());
+			}
+
+			// carriage return to the first column
+			consider(vertical + _T('\r') + Move(x, _T('C')), vertical.length() + 1 + Move(x, _T('C')).length());
+
+			// first column of line below or above
+			if (y != _cursor.Y)
+			{
+				auto line = Csi + Number(std::abs(y - _cursor.Y)) + (y > _cursor.Y ? _T('E') : _T('F')) + Move(x, _T('C'));
+				consider(std::move(line), line.length());
+			}
+		}
+
+		_out += best;
+		_cursor = COORD{ x, y };
+	}
+
+	void OutputEncoder::SetAttributes(WORD attributes)
+	{
+		if (_attributesKnown && attributes == _attributes)
+			return;
+
+		_out += Rendition(attributes);
+		_attributes = attributes;
+		_attributesKnown = true;
+	}
+
+	void OutputEncoder::Emit(SHORT x, SHORT y)
+	{
+		auto& cell = At(_next, x, y);
+
+		SetAttributes(cell.attributes);
+		_out += cell.text;
+
+		At(_shown, x, y) = cell;
+		if (cell.width == 2)
+			At(_shown, x + 1, y) = At(_next, x + 1, y);
+
+		// cursor waits for wrap after the last column
+		auto column = x + cell.width;
+		_cursor = column < _size.X ? COORD{ SHORT(column), y } : COORD{ -1, -1 };
+	}
+
+	tstring OutputEncoder::Move(int count, TCHAR direction)
+	{
+		if (count <= 0)
+			return tstring();
+
+		return Csi + (count > 1 ? Number(count) : tstring()) + direction;
+	}
+
+	tstring OutputEncoder::Rendition(WORD attributes) const
+	{
+		WORD fg = attributes & 0x0F;
+		WORD bg = (attributes >> 4) & 0x0F;
+
+		// colors console started with are terminal default ones
+		tstring parameters;
+		if (fg != (_defaults & 0x0F))
+			parameters += _T(";") + Number((fg & 0x08 ? 90 : 30) + Ansi(fg));
+		if (bg != ((_defaults >> 4) & 0x0F))
+			parameters += _T(";") + Number((bg & 0x08 ? 100 : 40) + Ansi(bg));
+		if (attributes & COMMON_LVB_UNDERSCORE)
+			parameters += _T(";4");
+
+		// reset is implied by empty parameters
+		return Csi + (parameters.empty() ? tstring() : _T("0") + parameters) + _T('m');
+	}
+
+	size_t OutputEncoder::Bytes(const tstring& text)
+	{
+#ifdef UNICODE
+		size_t bytes = 0u;
+		for (auto c : text)
+		{
+			if (c < 0x80)
+				bytes += 1;
+			else if (c < 0x800)
+				bytes += 2;
+			// half of surrogate pair, pair takes four bytes
+			else if (c >= 0xD800 && c < 0xE000)
+				bytes += 2;
+			else
+				bytes += 3;
+		}
+		return bytes;
+#else
+		return text.length();
+#endif
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <atomic>
+#include <cstdint>
+#include <windows.h>
+#include <TCHAR.h>
+
+namespace Menu
+{
+	// Encoder of screen changes into virtual terminal sequences.
+	// Keeps cells shown by terminal and cells drawn since the last present,
+	// only differences are sent choosing the shortest way to express them:
+	// relative or absolute cursor moves, overprinting of unchanged cells,
+	// erase to end of line and repeat of the previous character.
+	// Not thread safe, called with console locked.
+	class OutputEncoder
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+		using tcout = std::basic_ostream<TCHAR, std::char_traits<TCHAR>>;
+
+		// counters of sent output, bytes are counted as utf-8
+		struct Statistics
+		{
+			uint64_t frames;
+			uint64_t total_bytes;
+			uint64_t last_frame_bytes;
+		};
+
+		// c-tor
+		OutputEncoder() = default;
+
+		// set screen size, cells shown by terminal become unknown
+		void Resize(COORD size);
+
+		// return screen size
+		COORD GetSize() const { return _size; }
+
+		// attributes of console mapped to terminal default colors
+		void SetDefaultAttributes(WORD attributes);
+
+		// allow repeat sequence, some terminals do not support it
+		void SetRepeatEnabled(bool enabled) { _repeat = enabled; }
+
+		// draw text with attributes, cells outside of screen are dropped
+		void Put(COORD coord, const tstring& text, WORD attributes);
+
+		// send changes drawn since the last call, return count of bytes
+		size_t Present(tcout& stream);
+
+		// forget what terminal shows, the next present sends every cell
+		void Invalidate();
+
+		// return counters
+		Statistics GetStatistics() const;
+
+	private:
+
+		struct Cell
+		{
+			// grapheme, empty for the second column of wide one
+			tstring text;
+			WORD attributes;
+			// count of columns, 0 for the second column of wide grapheme
+			uint8_t width;
+			// false if terminal content is not known
+			bool known;
+
+			bool operator==(const Cell& other) const { return known == other.known && width == other.width && attributes == other.attributes && text == other.text; }
+			bool operator!=(const Cell& other) const { return !(*this == other); }
+		};
+
+		COORD _size{ 0, 0 };
+
+		// cells shown by terminal and cells to be shown
+		std::vector<Cell> _shown;
+		std::vector<Cell> _next;
+
+		// rows of next cells changed since the last present
+		std::vector<bool> _dirty;
+
+		WORD _defaults{ 0x07 };
+		bool _repeat{ true };
+
+		// terminal state, X < 0 if cursor position is not known
+		COORD _cursor{ -1, -1 };
+		WORD _attributes{ 0u };
+		bool _attributesKnown{ false };
+
+		// sequences of the current frame
+		tstring _out;
+
+		// statistics
+		std::atomic<uint64_t> _frames{ 0u };
+		std::atomic<uint64_t> _totalBytes{ 0u };
+		std::atomic<uint64_t> _lastFrameBytes{ 0u };
+
+		// return cell of screen
+		Cell& At(std::vector<Cell>& cells, SHORT x, SHORT y) { return cells[size_t(y) * _size.X + x]; }
+
+		// blank default cell
+		Cell Blank() const;
+
+		// break wide grapheme covering column of next cells
+		void Split(SHORT x, SHORT y);
+
+		// send changes of row
+		void EncodeRow(SHORT y);
+
+		// move cursor by the shortest sequence
+		void MoveTo(SHORT x, SHORT y);
+
+		// change attributes if they differ from terminal ones
+		void SetAttributes(WORD attributes);
+
+		// send cell and update terminal state
+		void Emit(SHORT x, SHORT y);
+
+		// return sequence of cursor movement by count in direction, empty if count is 0
+		static tstring Move(int count, TCHAR direction);
+
+		// return select graphic rendition sequence of attributes
+		tstring Rendition(WORD attributes) const;
+
+		// return count of utf-8 bytes of text
+		static size_t Bytes(const tstring& text);
+	};
+}
@@ -0,0 +1,87 @@
+#include "PathIndex.h"
+
+#include <algorithm>
+
+namespace Menu {
+
+	PathIndex::tstring PathIndex::EscapeCaption(const tstring& caption)
+	{
+		if (caption.find_first_of({ Separator, Escape }) == tstring::npos)
+			return caption;
+
+		tstring escaped;
+		escaped.reserve(caption.length() + 2u);
+		for (auto c : caption)
+		{
+			if (c == Separator || c == Escape)
+				escaped += Escape;
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	size_t PathIndex::FindSeparator(const tstring& path, size_t position)
+	{
+		for (; position < path.length(); ++position)
+		{
+			if (path[position] == Separator)
+				return position;
+
+			// escaped character is skipped
+			if (path[position] == Escape)
+				++position;
+		}
+		return tstring::npos;
+	}
+
+	void PathIndex::Add(const tstring& path, const std::shared_ptr<MenuItem>& item)
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+
+		// expired entries of removed items are dropped
+		auto& entries = _paths[path];
+		entries.erase(std::remove_if(entries.begin(), entries.end(), [](auto&& entry) { return entry.expired(); }), entries.end());
+		entries.emplace_back(item);
+	}
+
+	void PathIndex::Remove(const tstring& path, const MenuItem* item)
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+
+		auto entry = _paths.find(path);
+		if (entry == _paths.end())
+			return;
+
+		auto& entries = entry->second;
+		entries.erase(std::remove_if(entries.begin(), entries.end(), [item](auto&& entry)
+		{
+			auto indexed = entry.lock();
+			return !indexed || indexed.get() == item;
+		}), entries.end());
+
+		if (entries.empty())
+			_paths.erase(entry);
+	}
+
+	std::shared_ptr<MenuItem> PathIndex::Find(const tstring& path) const
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+
+		auto entry = _paths.find(path);
+		if (entry == _paths.end())
+			return nullptr;
+
+		for (auto&& item : entry->second)
+		{
+			if (auto indexed = item.lock())
+				return indexed;
+		}
+		return nullptr;
+	}
+
+	size_t PathIndex::Size() const
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+		return _paths.size();
+	}
+}
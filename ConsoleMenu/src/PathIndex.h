@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <windows.h>
+#include <TCHAR.h>
+
+namespace Menu
+{
+	class MenuItem;
+
+	// Index of items of menu tree by path of captions, "main/Node 1/Item 3".
+	// Shared by all nodes below the node which enabled it, nodes add and remove their children as they change.
+	// Lookup is one hash of path, it does not depend on size of tree.
+	// Items with the same path are kept in order of adding, the first one which is not removed is found.
+	// Separator and escape inside of caption are escaped, "main/A\/B" is item "A/B" of "main".
+	class PathIndex
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+
+		// separator of captions in path
+		static const TCHAR Separator{ _T('/') };
+
+		// escape of separator and of itself in caption
+		static const TCHAR Escape{ _T('\\') };
+
+		// return caption with escaped separators, it is one segment of path
+		static tstring EscapeCaption(const tstring& caption);
+
+		// return position of separator at or after position which is not escaped, npos if there is none
+		// position is the start of segment
+		static size_t FindSeparator(const tstring& path, size_t position);
+
+		// add item at path, item already found at path is kept and the new one is found after its removal
+		void Add(const tstring& path, const std::shared_ptr<MenuItem>& item);
+
+		// remove item at path, the next item with the same path is found instead
+		void Remove(const tstring& path, const MenuItem* item);
+
+		// return item at path or nullptr
+		std::shared_ptr<MenuItem> Find(const tstring& path) const;
+
+		// return count of paths
+		size_t Size() const;
+
+	private:
+
+		mutable std::mutex _mutex;
+
+		// items with the same path in order of adding
+		std::unordered_map<tstring, std::vector<std::weak_ptr<MenuItem>>> _paths;
+	};
+}
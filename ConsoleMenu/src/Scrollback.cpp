@@ -0,0 +1,328 @@
+#include "Scrollback.h"
+#include "Metrics.h"
+
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+namespace Menu {
+
+	namespace
+	{
+		// views must start on allocation granularity
+		const uint64_t ViewAlignment{ 0x10000u };
+
+		bool WriteAll(HANDLE file, const uint8_t* data, size_t size)
+		{
+			while (size)
+			{
+				DWORD written = 0;
+				if (WriteFile(file, data, static_cast<DWORD>(size), &written, nullptr) == 0 || written == 0)
+					return false;
+				data += written;
+				size -= written;
+			}
+			return true;
+		}
+	}
+
+	Scrollback::~Scrollback()
+	{
+		Close();
+	}
+
+	void Scrollback::Append(std::unique_ptr<tstring> str)
+	{
+		_hotBytes += GetLineSize(*str);
+		_hot.emplace_back(std::move(str));
+
+		if (_budget)
+			Spill();
+	}
+
+	Scrollback::tstring Scrollback::Get(size_t index) const
+	{
+		// lines of write buffer are still hot
+		if (index >= _spilled)
+			return *_hot[index - _spilled];
+
+		// walk from the nearest indexed record
+		auto record = index - _fileBase;
+		auto offset = _index[record / IndexStep];
+		for (auto skip = record % IndexStep; skip; --skip)
+		{
+			auto header = Map(offset, sizeof(uint32_t));
+			if (header == nullptr)
+				return tstring();
+
+			uint32_t length;
+			std::memcpy(&length, header, sizeof(length));
+			offset += sizeof(uint32_t) + uint64_t(length) * sizeof(TCHAR);
+		}
+
+		auto header = Map(offset, sizeof(uint32_t));
+		if (header == nullptr)
+			return tstring();
+
+		uint32_t length;
+		std::memcpy(&length, header, sizeof(length));
+
+		if (length == 0)
+			return tstring();
+
+		auto data = Map(offset + sizeof(uint32_t), uint64_t(length) * sizeof(TCHAR));
+		if (data == nullptr)
+			return tstring();
+
+		return tstring(reinterpret_cast<const TCHAR*>(data), length);
+	}
+
+	size_t Scrollback::Size() const
+	{
+		return End() - _first;
+	}
+
+	size_t Scrollback::First() const
+	{
+		return _first;
+	}
+
+	size_t Scrollback::End() const
+	{
+		return _spilled + _hot.size();
+	}
+
+	void Scrollback::PopFront()
+	{
+		if (_first < _spilled)
+		{
+			// records stay in segment file until all of them are removed or file is compacted
+			if (++_first == _spilled)
+			{
+				Close();
+				_index.clear();
+				_fileBase = _spilled;
+			}
+			else
+			{
+				Compact();
+			}
+		}
+		else if (!_hot.empty())
+		{
+			// the oldest line may be collected for writing, it is not written anymore
+			if (_pending)
+			{
+				_writeBuffer.clear();
+				_pending = 0u;
+				_pendingBytes = 0u;
+			}
+
+			_hotBytes -= GetLineSize(*_hot.front());
+			_hot.pop_front();
+
+			// segment file is empty, the next record starts it again
+			_first = ++_spilled;
+			_fileBase = _spilled;
+		}
+	}
+
+	void Scrollback::Clear()
+	{
+		_hot.clear();
+		_hotBytes = 0u;
+		_spilled = 0u;
+		_first = 0u;
+		_fileBase = 0u;
+		_index.clear();
+		_writeBuffer.clear();
+		_pending = 0u;
+		_pendingBytes = 0u;
+		_spillFailed = false;
+		Close();
+	}
+
+	void Scrollback::SetMemoryBudget(size_t bytes)
+	{
+		_budget = bytes;
+
+		if (_budget)
+			Spill();
+	}
+
+	size_t Scrollback::GetMemoryUsage() const
+	{
+		return _hotBytes;
+	}
+
+	void Scrollback::Spill()
+	{
+		if (_spillFailed)
+			return;
+
+		// the newest line always stays in memory, collected lines leave it when buffer is written
+		while (_hotBytes - _pendingBytes > _budget && _pending + 1 < _hot.size())
+		{
+			if (_file == INVALID_HANDLE_VALUE)
+			{
+				_file = CreateSegmentFile();
+
+				// keep lines in memory if segment file is not available
+				if (_file == INVALID_HANDLE_VALUE)
+					return;
+			}
+
+			auto& str = *_hot[_pending];
+
+			// record: length in characters and characters
+			uint32_t length = static_cast<uint32_t>(str.length());
+			auto data = reinterpret_cast<const uint8_t*>(str.data());
+
+			_writeBuffer.insert(_writeBuffer.end(), reinterpret_cast<const uint8_t*>(&length), reinterpret_cast<const uint8_t*>(&length) + sizeof(length));
+			_writeBuffer.insert(_writeBuffer.end(), data, data + length * sizeof(TCHAR));
+
+			++_pending;
+			_pendingBytes += GetLineSize(str);
+
+			if (_writeBuffer.size() >= WriteBufferSize && !Flush())
+				return;
+		}
+	}
+
+	bool Scrollback::Flush()
+	{
+		if (!WriteAll(_file, _writeBuffer.data(), _writeBuffer.size()))
+		{
+			// file may end with a part of buffer, nothing is appended after it and its lines stay hot
+			Metrics::Add(Metric::m_spill_failures);
+			_spillFailed = true;
+			_writeBuffer.clear();
+			_pending = 0u;
+			_pendingBytes = 0u;
+			return false;
+		}
+
+		for (; _pending; --_pending)
+		{
+			auto& str = *_hot.front();
+
+			if ((_spilled - _fileBase) % IndexStep == 0)
+				_index.emplace_back(_fileSize);
+
+			_fileSize += sizeof(uint32_t) + uint64_t(str.length()) * sizeof(TCHAR);
+			_hotBytes -= GetLineSize(str);
+			_hot.pop_front();
+			++_spilled;
+		}
+
+		_pendingBytes = 0u;
+		_writeBuffer.clear();
+		return true;
+	}
+
+	void Scrollback::Compact()
+	{
+		// records are cut at indexed offsets, a few removed ones may stay
+		auto steps = (_first - _fileBase) / IndexStep;
+		auto offset = _index[steps];
+
+		// file is at most twice as big as records kept in it
+		if (offset < CompactSize || offset < _fileSize - offset)
+			return;
+
+		auto file = CreateSegmentFile();
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+
+		for (auto position = offset; position < _fileSize;)
+		{
+			auto size = _fileSize - position > ViewSize ? ViewSize : _fileSize - position;
+			auto data = Map(position, size);
+			if (data == nullptr || !WriteAll(file, data, static_cast<size_t>(size)))
+			{
+				CloseHandle(file);
+				return;
+			}
+			position += size;
+		}
+
+		auto size = _fileSize - offset;
+		Close();
+
+		_file = file;
+		_fileSize = size;
+		_fileBase += steps * IndexStep;
+		_index.erase(_index.begin(), _index.begin() + steps);
+		for (auto&& entry : _index)
+			entry -= offset;
+	}
+
+	HANDLE Scrollback::CreateSegmentFile()
+	{
+		TCHAR path[MAX_PATH];
+		TCHAR name[MAX_PATH];
+
+		if (GetTempPath(MAX_PATH, path) == 0 || GetTempFileName(path, _T("cmf"), 0, name) == 0)
+			return INVALID_HANDLE_VALUE;
+
+		return CreateFile(name, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	}
+
+	const uint8_t* Scrollback::Map(uint64_t offset, uint64_t size) const
+	{
+		if (_view && offset >= _viewOffset && offset + size <= _viewOffset + _viewSize)
+			return _view + (offset - _viewOffset);
+
+		if (_view)
+		{
+			UnmapViewOfFile(_view);
+			_view = nullptr;
+		}
+
+		// mapping covers file size at the moment of creation, recreate it when file grows
+		if (offset + size > _mapSize)
+		{
+			if (_map)
+				CloseHandle(_map);
+
+			_map = CreateFileMapping(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			_mapSize = _map ? _fileSize : 0u;
+
+			if (_map == nullptr || offset + size > _mapSize)
+				return nullptr;
+		}
+
+		_viewOffset = offset & ~(ViewAlignment - 1);
+		_viewSize = offset + size - _viewOffset > ViewSize ? offset + size - _viewOffset : ViewSize;
+		if (_viewOffset + _viewSize > _mapSize)
+			_viewSize = _mapSize - _viewOffset;
+
+		_view = static_cast<const uint8_t*>(MapViewOfFile(_map, FILE_MAP_READ, DWORD(_viewOffset >> 32), DWORD(_viewOffset), size_t(_viewSize)));
+
+		return _view ? _view + (offset - _viewOffset) : nullptr;
+	}
+
+	void Scrollback::Close()
+	{
+		if (_view)
+			UnmapViewOfFile(_view);
+		if (_map)
+			CloseHandle(_map);
+		if (_file != INVALID_HANDLE_VALUE)
+			CloseHandle(_file);
+
+		_view = nullptr;
+		_viewOffset = 0u;
+		_viewSize = 0u;
+		_map = nullptr;
+		_mapSize = 0u;
+		_file = INVALID_HANDLE_VALUE;
+		_fileSize = 0u;
+	}
+
+	size_t Scrollback::GetLineSize(const tstring& str)
+	{
+		return sizeof(tstring) + str.capacity() * sizeof(TCHAR);
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <windows.h>
+#include <TCHAR.h>
+
+namespace Menu
+{
+	// Lines of MenuFrame.
+	// Recent lines are kept in memory while their size fits memory budget,
+	// older lines are appended to temporary segment file and read back through mapped views.
+	// Lines leave memory only after their records are written, if writing fails spilling stops until Clear.
+	// Segment file is rewritten without removed records once they take more than the rest of it.
+	// Lines keep their index while oldest ones are removed, valid indexes are [First(), End()).
+	// Not thread safe, owner guards access.
+	class Scrollback
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+
+		// c-tor
+		Scrollback() = default;
+
+		// d-tor
+		~Scrollback();
+
+		Scrollback(const Scrollback&) = delete;
+		Scrollback& operator=(const Scrollback&) = delete;
+
+		// append line to the end
+		void Append(std::unique_ptr<tstring> str);
+
+		// return line by index
+		tstring Get(size_t index) const;
+
+		// return count of lines
+		size_t Size() const;
+
+		// return index of the first line
+		size_t First() const;
+
+		// return index after the last line
+		size_t End() const;
+
+		// remove the oldest line
+		void PopFront();
+
+		// remove all lines and segment file
+		void Clear();
+
+		// set size of lines kept in memory in bytes, 0 - unlimited
+		void SetMemoryBudget(size_t bytes);
+
+		// return size of lines kept in memory in bytes
+		size_t GetMemoryUsage() const;
+
+	private:
+
+		// count of records between two stored offsets of segment file
+		static const size_t IndexStep{ 256u };
+
+		// size of mapped view of segment file
+		static const uint64_t ViewSize{ 16u << 20 };
+
+		// size of records collected before they are written
+		static const size_t WriteBufferSize{ 1u << 20 };
+
+		// size of removed records at the beginning of segment file which is worth rewriting it
+		static const uint64_t CompactSize{ 16u << 20 };
+
+		// recent lines, the first one has index _spilled
+		std::deque<std::unique_ptr<tstring>> _hot;
+
+		// size of hot lines in bytes
+		size_t _hotBytes{ 0u };
+
+		// maximum size of hot lines, 0 - unlimited
+		size_t _budget{ 0u };
+
+		// index of the first hot line, all older lines were moved to segment file
+		size_t _spilled{ 0u };
+
+		// index of the first line which is not removed
+		size_t _first{ 0u };
+
+		// index of the first record of segment file
+		size_t _fileBase{ 0u };
+
+		// offsets of every IndexStep record in segment file
+		std::vector<uint64_t> _index;
+
+		// records of the oldest hot lines not written to segment file yet
+		std::vector<uint8_t> _writeBuffer;
+
+		// count of hot lines in write buffer and their size in bytes
+		size_t _pending{ 0u };
+		size_t _pendingBytes{ 0u };
+
+		// size of written records of segment file
+		uint64_t _fileSize{ 0u };
+
+		// true if segment file could not be written, lines are kept in memory
+		bool _spillFailed{ false };
+
+		// segment file, deleted on close
+		HANDLE _file{ INVALID_HANDLE_VALUE };
+
+		// mapping of segment file and its size
+		mutable HANDLE _map{ nullptr };
+		mutable uint64_t _mapSize{ 0u };
+
+		// mapped window of segment file
+		mutable const uint8_t* _view{ nullptr };
+		mutable uint64_t _viewOffset{ 0u };
+		mutable uint64_t _viewSize{ 0u };
+
+		// move the oldest hot lines to segment file while budget is exceeded
+		void Spill();
+
+		// write collected records to segment file and remove their lines from memory
+		// return false and stop spilling if they are not written
+		bool Flush();
+
+		// copy records which are not removed to new segment file if removed ones take most of it
+		void Compact();
+
+		// return new temporary segment file or INVALID_HANDLE_VALUE
+		static HANDLE CreateSegmentFile();
+
+		// return pointer to [offset, offset + size) of segment file
+		const uint8_t* Map(uint64_t offset, uint64_t size) const;
+
+		// close views and segment file
+		void Close();
+
+		// memory taken by line
+		static size_t GetLineSize(const tstring& str);
+	};
+}
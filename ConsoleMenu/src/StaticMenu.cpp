@@ -0,0 +1,55 @@
+#include "StaticMenu.h"
+
+namespace Menu {
+
+	namespace Static {
+
+		StaticMenuNode::StaticMenuNode(const Entry& entry) :MenuNode(entry.caption), _entry(entry)
+		{
+			SetPolicy(entry.policy);
+		}
+
+		void StaticMenuNode::Execute()
+		{
+			Expand();
+			MenuNode::Execute();
+		}
+
+		void StaticMenuNode::Expand()
+		{
+			std::lock_guard<std::mutex> lk(_expandMutex);
+
+			if (_materialized)
+				return;
+
+			std::vector<std::shared_ptr<MenuItem>> items;
+			items.reserve(_entry.count);
+			for (size_t i = 0u; i < _entry.count; ++i)
+				items.emplace_back(Build(_entry.children[i]));
+
+			// children are published by one copy of the list, hotkeys are taken from the array resolved by declaration
+			Batch([&]
+			{
+				for (size_t i = 0u; i < items.size(); ++i)
+					Add(std::move(items[i]), _entry.keys[i]);
+			});
+
+			_materialized = true;
+		}
+
+		std::shared_ptr<MenuItem> Build(const Entry& entry)
+		{
+			std::shared_ptr<MenuItem> item;
+
+			if (entry.children)
+				item = std::make_shared<StaticMenuNode>(entry);
+			else
+				item = std::make_shared<MenuItem>(entry.caption);
+
+			if (entry.callback)
+				item->Connect(entry.callback);
+
+			return item;
+		}
+	}
+}
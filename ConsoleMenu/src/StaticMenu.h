@@ -0,0 +1,203 @@
+#pragma once
+
+#include "Menu.h"
+
+#include <cstdint>
+#include <utility>
+
+namespace Menu
+{
+	// Menus fixed at build time.
+	//
+	// Tree is declared with constexpr Item/Children/Node calls over static arrays and lives in read-only data:
+	//
+	//	constexpr Static::Entry fileItems[] = { Static::Item(_T("Open"), &OnOpen), Static::Item(_T("Save"), &OnSave, _T('V')) };
+	//	constexpr auto fileChildren = Static::Children(fileItems);
+	//	constexpr Static::Entry mainItems[] = { Static::Node(_T("File"), fileChildren), Static::Item(_T("Quit"), &OnQuit) };
+	//	constexpr auto mainChildren = Static::Children(mainItems);
+	//	constexpr Static::Entry mainMenu = Static::Node(_T("main"), mainChildren);
+	//	static_assert(Static::IsValid(mainMenu), "menu hotkeys conflict");
+	//
+	// Hotkeys are resolved at compile time by the node policy into the key array of Children, nodes only index it.
+	// Explicit hotkeys are allowed for hp_letters only, letters policy considers A-Z and 0-9 characters of the caption.
+	namespace Static
+	{
+		using HotkeyPolicy = MenuNode::HotkeyPolicy;
+
+		struct Entry
+		{
+			// menu text
+			const TCHAR* caption;
+
+			// children of node, nullptr for item
+			const Entry* children;
+
+			// count of children
+			size_t count;
+
+			// hotkey generation policy of node children
+			HotkeyPolicy policy;
+
+			// hotkey chosen explicitly, 0 - generated by parent policy
+			size_t hotkey;
+
+			// callback, may be nullptr
+			bool(*callback)();
+
+			// hotkey codes of children resolved at compile time, nullptr for item
+			const size_t* keys;
+		};
+
+		// children of node with their hotkeys, declared as constexpr variable so nodes can point to its keys
+		template <size_t N>
+		struct ChildList
+		{
+			const Entry* entries;
+			HotkeyPolicy policy;
+			size_t keys[N];
+		};
+
+		// declare menu item
+		constexpr Entry Item(const TCHAR* caption, bool(*callback)() = nullptr, size_t hotkey = 0u)
+		{
+			return Entry{ caption, nullptr, 0u, HotkeyPolicy::hp_none, hotkey, callback, nullptr };
+		}
+
+		constexpr size_t Upper(size_t letter)
+		{
+			return letter >= 'a' && letter <= 'z' ? letter - 'a' + 'A' : letter;
+		}
+
+		// bit of key in the set of letters A-Z and digits 0-9, 0 if key cannot be used
+		constexpr uint64_t KeyBit(size_t key)
+		{
+			return key >= 'A' && key <= 'Z' ? uint64_t(1u) << (key - 'A')
+				: key >= '0' && key <= '9' ? uint64_t(1u) << (26u + key - '0')
+				: 0u;
+		}
+
+		// first character of caption which is not used yet, 0 if none
+		constexpr size_t FirstFreeLetter(const TCHAR* caption, uint64_t used)
+		{
+			return *caption == 0 ? 0u
+				: KeyBit(Upper(*caption)) && !(used & KeyBit(Upper(*caption))) ? Upper(*caption)
+				: FirstFreeLetter(caption + 1, used);
+		}
+
+		// letter of child when previous siblings took used keys
+		constexpr size_t LetterKey(const Entry& child, uint64_t used)
+		{
+			return child.hotkey ? Upper(child.hotkey) : FirstFreeLetter(child.caption, used);
+		}
+
+		// children are walked by blocks, so constexpr recursion is not deeper than count / KeyBlock + KeyBlock
+		const size_t KeyBlock{ 32u };
+
+		// keys taken by children [index, last) added to used
+		constexpr uint64_t UsedKeys(const Entry* children, size_t index, size_t last, uint64_t used = 0u)
+		{
+			return index >= last ? used
+				: UsedKeys(children, index + 1, last, used | KeyBit(LetterKey(children[index], used)));
+		}
+
+		// keys taken by children before index, first block starts at from
+		constexpr uint64_t UsedKeysBefore(const Entry* children, size_t index, size_t from = 0u, uint64_t used = 0u)
+		{
+			return index - from <= KeyBlock ? UsedKeys(children, from, index, used)
+				: UsedKeysBefore(children, index, from + KeyBlock, UsedKeys(children, from, from + KeyBlock, used));
+		}
+
+		// hotkey code of child as it is processed by MenuNode
+		constexpr size_t Key(const Entry* children, HotkeyPolicy policy, size_t index)
+		{
+			return policy == HotkeyPolicy::hp_letters ? LetterKey(children[index], UsedKeysBefore(children, index))
+				: policy == HotkeyPolicy::hp_numbers ? (index < 9u ? index + 1u : 0u)
+				: policy == HotkeyPolicy::hp_fx_keys ? (index < 10u ? 59u + index : index < 12u ? 133u + index - 10u : 0u)
+				: 0u;
+		}
+
+		template <size_t N, size_t... Indexes>
+		constexpr ChildList<N> MakeChildList(const Entry(&children)[N], HotkeyPolicy policy, std::index_sequence<Indexes...>)
+		{
+			return ChildList<N>{ children, policy, { Key(children, policy, Indexes)... } };
+		}
+
+		// declare children of node and resolve their hotkeys
+		template <size_t N>
+		constexpr ChildList<N> Children(const Entry(&children)[N], HotkeyPolicy policy = HotkeyPolicy::hp_letters)
+		{
+			return MakeChildList(children, policy, std::make_index_sequence<N>());
+		}
+
+		// declare menu node, children must be a constexpr variable
+		template <size_t N>
+		constexpr Entry Node(const TCHAR* caption, const ChildList<N>& children, size_t hotkey = 0u)
+		{
+			return Entry{ caption, children.entries, N, children.policy, hotkey, nullptr, children.keys };
+		}
+
+		// true if explicit hotkey of child does not clash with keys taken before
+		constexpr bool HasNoConflict(const Entry& node, size_t index)
+		{
+			return node.children[index].hotkey == 0u
+				|| (node.policy == HotkeyPolicy::hp_letters
+					&& KeyBit(Upper(node.children[index].hotkey))
+					&& !(UsedKeysBefore(node.children, index) & KeyBit(Upper(node.children[index].hotkey))));
+		}
+
+		// true if explicit hotkeys of children [begin, end) do not clash, halves keep recursion shallow
+		constexpr bool HasNoConflicts(const Entry& node, size_t begin, size_t end)
+		{
+			return end <= begin ? true
+				: end - begin == 1u ? HasNoConflict(node, begin)
+				: HasNoConflicts(node, begin, begin + (end - begin) / 2u) && HasNoConflicts(node, begin + (end - begin) / 2u, end);
+		}
+
+		constexpr bool IsValid(const Entry& entry);
+
+		constexpr bool AreChildrenValid(const Entry& node, size_t begin, size_t end)
+		{
+			return end <= begin ? true
+				: end - begin == 1u ? IsValid(node.children[begin])
+				: AreChildrenValid(node, begin, begin + (end - begin) / 2u) && AreChildrenValid(node, begin + (end - begin) / 2u, end);
+		}
+
+		// true if the whole tree has no hotkey conflicts, use with static_assert
+		constexpr bool IsValid(const Entry& entry)
+		{
+			return entry.children == nullptr || (HasNoConflicts(entry, 0u, entry.count) && AreChildrenValid(entry, 0u, entry.count));
+		}
+
+		// node driven by regular MenuNode engine, children are created from static entry on the first enter
+		class StaticMenuNode : public MenuNode
+		{
+		public:
+
+			// c-tor
+			explicit StaticMenuNode(const Entry& entry);
+
+			// v d-tor
+			virtual ~StaticMenuNode() = default;
+
+			// create children if needed and call menu
+			void Execute() override;
+
+			// create children if needed
+			void Expand() override;
+
+		private:
+
+			// static declaration of node
+			const Entry& _entry;
+
+			// serializes creation of children
+			std::mutex _expandMutex;
+
+			// true if children are created
+			bool _materialized{ false };
+		};
+
+		// create menu item or node for static entry
+		std::shared_ptr<MenuItem> Build(const Entry& entry);
+	}
+}
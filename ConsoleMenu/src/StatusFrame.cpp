@@ -0,0 +1,234 @@
+#include "StatusFrame.h"
+
+namespace Menu {
+
+	namespace
+	{
+		// between name and value
+		const tstring Separator{ _T(": ") };
+	}
+
+	StatusFrame::StatusFrame(const tstring& caption) :MenuFrame(caption)
+	{
+	}
+
+	StatusFrame::~StatusFrame()
+	{
+		StopPolling();
+	}
+
+	void StatusFrame::Set(const tstring& name, const tstring& value)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_cellsMutex);
+
+			// new row draws its name even without value
+			auto rows = _cells.size();
+			auto& cell = GetCell(name);
+			if (cell.value == value && _cells.size() == rows)
+				return;
+
+			cell.value = value;
+		}
+		Update();
+	}
+
+	void StatusFrame::Set(const std::vector<std::pair<tstring, tstring>>& values)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_cellsMutex);
+
+			for (auto&& value : values)
+				GetCell(value.first).value = value.second;
+		}
+		Update();
+	}
+
+	void StatusFrame::Bind(const tstring& name, std::function<tstring()> getter)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_cellsMutex);
+
+			auto rows = _cells.size();
+			GetCell(name).getter = getter;
+			if (_cells.size() == rows)
+				return;
+		}
+		Update();
+	}
+
+	void StatusFrame::Poll()
+	{
+		std::vector<std::pair<size_t, std::function<tstring()>>> getters;
+		{
+			std::lock_guard<std::mutex> lk(_cellsMutex);
+			for (size_t i = 0u; i < _cells.size(); ++i)
+			{
+				if (_cells[i].getter)
+					getters.emplace_back(i, _cells[i].getter);
+			}
+		}
+
+		if (getters.empty())
+			return;
+
+		// getters are evaluated without lock, they may be slow
+		std::vector<tstring> values;
+		values.reserve(getters.size());
+		for (auto&& getter : getters)
+			values.emplace_back(getter.second());
+
+		auto changed = false;
+		{
+			std::lock_guard<std::mutex> lk(_cellsMutex);
+			for (size_t i = 0u; i < getters.size(); ++i)
+			{
+				auto& cell = _cells[getters[i].first];
+				if (cell.value != values[i])
+				{
+					cell.value = std::move(values[i]);
+					changed = true;
+				}
+			}
+		}
+
+		if (changed)
+			Update();
+	}
+
+	void StatusFrame::StartPolling(std::chrono::milliseconds interval)
+	{
+		StopPolling();
+
+		_polling = true;
+		_pollThread = std::thread([this, interval]()
+		{
+			std::unique_lock<std::mutex> lk(_pollMutex);
+			while (_polling)
+			{
+				lk.unlock();
+				Poll();
+				lk.lock();
+
+				_pollCondition.wait_for(lk, interval, [this]() { return !_polling; });
+			}
+		});
+	}
+
+	void StatusFrame::StopPolling()
+	{
+		{
+			std::lock_guard<std::mutex> lk(_pollMutex);
+			_polling = false;
+		}
+		_pollCondition.notify_all();
+
+		if (_pollThread.joinable())
+			_pollThread.join();
+	}
+
+	tstring StatusFrame::Get(const tstring& name) const
+	{
+		std::lock_guard<std::mutex> lk(_cellsMutex);
+
+		auto row = _rows.find(name);
+		return row != _rows.end() ? _cells[row->second].value : tstring();
+	}
+
+	void StatusFrame::Draw()
+	{
+		if (_hOutput == nullptr)
+			return;
+
+		COORD origin;
+		short width;
+		int lines;
+		if (!GetTextArea(origin, width, lines))
+			return;
+
+		std::lock_guard<std::mutex> lk(_cellsMutex);
+
+		auto rows = _cells.size() < size_t(lines) ? _cells.size() : size_t(lines);
+		auto valueColumn = _nameWidth + Separator.length();
+
+		for (size_t i = 0u; i < rows; ++i)
+		{
+			auto& cell = _cells[i];
+			COORD coord = { origin.X, static_cast<SHORT>(origin.Y + i) };
+
+			if (_fullRedraw || !cell.labelDrawn)
+			{
+				auto name = cell.name + tstring(_nameWidth - Text::Width(cell.name), _T(' ')) + Separator;
+
+				Write(coord, Text::Truncate(name, width));
+
+				// value is drawn again, the rest of the old one is erased up to drawnEnd
+				cell.drawn.clear();
+				cell.labelDrawn = true;
+			}
+			else if (cell.value == cell.drawn)
+			{
+				continue;
+			}
+
+			// characters matching the drawn value stay on screen
+			auto common = size_t(std::mismatch(cell.drawn.begin(), cell.drawn.begin() + std::min(cell.drawn.length(), cell.value.length()), cell.value.begin()).first - cell.drawn.begin());
+#ifdef UNICODE
+			// do not split surrogate pair
+			if (common && cell.value[common - 1] >= 0xD800 && cell.value[common - 1] < 0xDC00)
+				--common;
+#endif
+			auto prefixWidth = Text::Width(cell.value.substr(0u, common));
+
+			if (valueColumn + prefixWidth < size_t(width))
+			{
+				auto available = width - valueColumn - prefixWidth;
+				auto tail = Text::Truncate(cell.value.substr(common), available);
+				auto tailWidth = Text::Width(tail);
+
+				// erase rest of the longer previous value, it may start at the column of the old layout
+				auto start = valueColumn + prefixWidth;
+				auto oldTailWidth = cell.drawnEnd > start ? cell.drawnEnd - start : 0u;
+				auto erase = oldTailWidth > tailWidth ? std::min(oldTailWidth, available) - tailWidth : 0u;
+
+				coord.X = static_cast<SHORT>(origin.X + start);
+				Write(coord, tail + tstring(erase, _T(' ')));
+
+				cell.drawnEnd = start + tailWidth;
+			}
+			cell.drawn = cell.value;
+		}
+
+		_fullRedraw = false;
+		_outstream.flush();
+	}
+
+	void StatusFrame::OnGridDrawn()
+	{
+		std::lock_guard<std::mutex> lk(_cellsMutex);
+		_fullRedraw = true;
+
+		// text area is blank
+		for (auto&& cell : _cells)
+			cell.drawnEnd = 0u;
+	}
+
+	StatusFrame::Cell& StatusFrame::GetCell(const tstring& name)
+	{
+		auto row = _rows.find(name);
+		if (row != _rows.end())
+			return _cells[row->second];
+
+		// longer name moves values column
+		auto nameWidth = Text::Width(name);
+		if (nameWidth > _nameWidth)
+		{
+			_nameWidth = nameWidth;
+			_fullRedraw = true;
+		}
+
+		_rows.emplace(name, _cells.size());
+		_cells.emplace_back(Cell{ name, tstring(), tstring(), 0u, nullptr, false });
+		return _cells.back();
+	}
+}
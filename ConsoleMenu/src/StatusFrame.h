@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Menu.h"
+
+#include <thread>
+#include <condition_variable>
+
+namespace Menu
+{
+	// Frame showing named values as "name: value" rows.
+	// Values are pushed by Set or polled from bound getters, repaint rewrites only changed characters of changed values.
+	class StatusFrame : public MenuFrame
+	{
+	public:
+
+		// c-tor
+		explicit StatusFrame(const tstring& caption);
+
+		// d-tor, stops polling
+		virtual ~StatusFrame();
+
+		// set value, row is added on the first use of name
+		void Set(const tstring& name, const tstring& value);
+
+		// set several values with single repaint
+		void Set(const std::vector<std::pair<tstring, tstring>>& values);
+
+		// bind value to getter evaluated by Poll
+		void Bind(const tstring& name, std::function<tstring()> getter);
+
+		// evaluate bound getters and repaint changed values
+		virtual void Poll();
+
+		// evaluate bound getters periodically on background thread
+		void StartPolling(std::chrono::milliseconds interval);
+
+		// stop background polling
+		void StopPolling();
+
+		// return value by name or empty string
+		tstring Get(const tstring& name) const;
+
+	protected:
+
+		// draw changed values
+		void Draw() override;
+
+		// text area is blank, draw everything
+		void OnGridDrawn() override;
+
+	private:
+
+		struct Cell
+		{
+			tstring name;
+
+			// current value
+			tstring value;
+
+			// value on screen
+			tstring drawn;
+
+			// columns of row taken on screen from the text area origin, value of the old layout included
+			size_t drawnEnd;
+
+			// getter of bound value
+			std::function<tstring()> getter;
+
+			// name is on screen, rows added after the last full redraw draw it once
+			bool labelDrawn;
+		};
+
+		// rows in order of addition
+		std::vector<Cell> _cells;
+
+		// row index by name
+		std::unordered_map<tstring, size_t> _rows;
+
+		// width of the names column
+		size_t _nameWidth{ 0u };
+
+		// names or layout changed, all rows have to be drawn
+		bool _fullRedraw{ true };
+
+		mutable std::mutex _cellsMutex;
+
+		// polling thread
+		std::thread _pollThread;
+		std::mutex _pollMutex;
+		std::condition_variable _pollCondition;
+		bool _polling{ false };
+
+		// return row for name, adds new one if needed, cells must be locked
+		Cell& GetCell(const tstring& name);
+	};
+}
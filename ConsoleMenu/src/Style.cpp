@@ -0,0 +1,122 @@
+#include "Style.h"
+
+#include <algorithm>
+
+namespace Menu {
+
+	namespace
+	{
+		const WORD ColorMask{ 0x0F };
+		const WORD Intensity{ 0x08 };
+		const WORD Underscore{ 0x8000 };
+	}
+
+	WORD Style::ToAttributes(WORD defaults) const
+	{
+		WORD fg = foreground == Color::c_default ? defaults & ColorMask : WORD(foreground);
+		WORD bg = background == Color::c_default ? (defaults >> 4) & ColorMask : WORD(background);
+
+		if (flags & sf_bold)
+			fg |= Intensity;
+
+		if (flags & sf_reverse)
+			std::swap(fg, bg);
+
+		WORD attributes = (defaults & 0xFF00) | bg << 4 | fg;
+		if (flags & sf_underline)
+			attributes |= Underscore;
+
+		return attributes;
+	}
+
+	StyledText::StyledText(const tstring& text, Style style) :_text(text)
+	{
+		if (!style.IsDefault())
+			AddSpan(text.length(), style);
+	}
+
+	StyledText& StyledText::Append(const tstring& text, Style style)
+	{
+		if (text.empty())
+			return *this;
+
+		// plain text gets runs only when styled part appears
+		if (_spans.empty() && !style.IsDefault() && !_text.empty())
+			AddSpan(_text.length(), Style());
+
+		_text += text;
+
+		if (!_spans.empty() || !style.IsDefault())
+			AddSpan(text.length(), style);
+
+		return *this;
+	}
+
+	StyledText& StyledText::Append(const StyledText& text)
+	{
+		if (text._spans.empty())
+			return Append(text._text);
+
+		if (_spans.empty() && !_text.empty())
+			AddSpan(_text.length(), Style());
+
+		_text += text._text;
+		for (auto&& span : text._spans)
+			AddSpan(span.length, span.style);
+
+		return *this;
+	}
+
+	StyledText StyledText::Substr(size_t begin, size_t count) const
+	{
+		StyledText result;
+		result._text = _text.substr(begin, count);
+
+		if (_spans.empty())
+			return result;
+
+		auto end = begin + result._text.length();
+		size_t position = 0u;
+		for (auto&& span : _spans)
+		{
+			auto first = std::max<size_t>(position, begin);
+			auto last = std::min<size_t>(position + span.length, end);
+			if (first < last)
+				result.AddSpan(last - first, span.style);
+
+			position += span.length;
+			if (position >= end)
+				break;
+		}
+		return result;
+	}
+
+	void StyledText::AddFlags(uint8_t flags)
+	{
+		if (_spans.empty())
+		{
+			AddSpan(_text.length(), Style(Color::c_default, Color::c_default, flags));
+			return;
+		}
+
+		std::vector<StyleSpan> spans;
+		spans.swap(_spans);
+		for (auto&& span : spans)
+		{
+			auto style = span.style;
+			style.flags |= flags;
+			AddSpan(span.length, style);
+		}
+	}
+
+	void StyledText::AddSpan(size_t length, Style style)
+	{
+		if (length == 0)
+			return;
+
+		if (!_spans.empty() && _spans.back().style == style)
+			_spans.back().length += static_cast<uint32_t>(length);
+		else
+			_spans.emplace_back(StyleSpan{ static_cast<uint32_t>(length), style });
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <windows.h>
+#include <TCHAR.h>
+
+namespace Menu
+{
+	// console colors, values are console attribute bits
+	enum class Color : uint8_t
+	{
+		c_black,
+		c_blue,
+		c_green,
+		c_cyan,
+		c_red,
+		c_magenta,
+		c_yellow,
+		c_white,
+		c_gray,
+		c_light_blue,
+		c_light_green,
+		c_light_cyan,
+		c_light_red,
+		c_light_magenta,
+		c_light_yellow,
+		c_bright_white,
+		// color of console when menu started
+		c_default,
+	};
+
+	// colors and attributes of characters
+	struct Style
+	{
+		enum Flags : uint8_t
+		{
+			sf_none = 0,
+			// intense foreground
+			sf_bold = 1,
+			// swap foreground and background
+			sf_reverse = 2,
+			sf_underline = 4,
+		};
+
+		Color foreground;
+		Color background;
+		uint8_t flags;
+
+		// c-tor
+		Style(Color fg = Color::c_default, Color bg = Color::c_default, uint8_t fl = sf_none) :foreground(fg), background(bg), flags(fl) {};
+
+		bool operator==(const Style& other) const { return foreground == other.foreground && background == other.background && flags == other.flags; }
+		bool operator!=(const Style& other) const { return !(*this == other); }
+
+		// return true if console colors are not changed
+		bool IsDefault() const { return *this == Style(); }
+
+		// return console attributes based on attributes console started with
+		WORD ToAttributes(WORD defaults) const;
+	};
+
+	// style of run of characters
+	struct StyleSpan
+	{
+		uint32_t length;
+		Style style;
+
+		bool operator==(const StyleSpan& other) const { return length == other.length && style == other.style; }
+		bool operator!=(const StyleSpan& other) const { return !(*this == other); }
+	};
+
+	// Text with style runs, adjacent runs of the same style are merged.
+	class StyledText
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+
+		// c-tor
+		StyledText() = default;
+
+		// c-tor, plain text
+		StyledText(const tstring& text) :_text(text) {};
+
+		// c-tor, whole text of the same style
+		StyledText(const tstring& text, Style style);
+
+		// c-tor, runs must cover the whole text or be empty
+		StyledText(const tstring& text, const std::vector<StyleSpan>& spans) :_text(text), _spans(spans) {};
+
+		// append text of style
+		StyledText& Append(const tstring& text, Style style = Style());
+
+		// append styled text
+		StyledText& Append(const StyledText& text);
+
+		// return [begin, begin + count) characters with their styles
+		StyledText Substr(size_t begin, size_t count = tstring::npos) const;
+
+		// add flags to every character
+		void AddFlags(uint8_t flags);
+
+		// return characters
+		const tstring& GetText() const { return _text; }
+
+		// return runs, empty if text is plain
+		const std::vector<StyleSpan>& GetSpans() const { return _spans; }
+
+		bool operator==(const StyledText& other) const { return _text == other._text && _spans == other._spans; }
+		bool operator!=(const StyledText& other) const { return !(*this == other); }
+
+	private:
+
+		tstring _text;
+
+		// runs covering the whole text, empty if all characters have default style
+		std::vector<StyleSpan> _spans;
+
+		// append run merging it with the last one
+		void AddSpan(size_t length, Style style);
+	};
+}
@@ -0,0 +1,532 @@
+#include "TableFrame.h"
+
+#include <thread>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+namespace Menu {
+
+	namespace
+	{
+		// parts smaller than this are not split between threads
+		const size_t MinSortPart{ 1u << 16 };
+
+#ifdef UNICODE
+		const TCHAR AscendingSymbol{ _T('\x25B2') };
+		const TCHAR DescendingSymbol{ _T('\x25BC') };
+#else
+		const TCHAR AscendingSymbol{ _T('^') };
+		const TCHAR DescendingSymbol{ _T('v') };
+#endif
+
+		// empty cells of number columns are NaN and go after numbers in both orders
+		bool NumberLess(double left, double right)
+		{
+			return !std::isnan(left) && (std::isnan(right) || left < right);
+		}
+
+		bool NumberGreater(double left, double right)
+		{
+			return !std::isnan(left) && (std::isnan(right) || left > right);
+		}
+
+		// stable sort of parts on separate threads followed by pairwise merging of neighbour parts
+		template<class Compare>
+		void ParallelSort(std::vector<uint32_t>& order, Compare compare)
+		{
+			size_t threads = std::thread::hardware_concurrency();
+			auto parts = std::max<size_t>(1u, std::min<size_t>(threads, order.size() / MinSortPart));
+
+			std::vector<size_t> bounds;
+			for (size_t i = 0u; i <= parts; ++i)
+				bounds.emplace_back(order.size() * i / parts);
+
+			auto begin = order.begin();
+			{
+				std::vector<std::thread> workers;
+				for (size_t i = 1u; i < parts; ++i)
+					workers.emplace_back([&, i]() { std::stable_sort(begin + bounds[i], begin + bounds[i + 1], compare); });
+
+				std::stable_sort(begin + bounds[0], begin + bounds[1], compare);
+
+				for (auto&& worker : workers)
+					worker.join();
+			}
+
+			while (bounds.size() > 2)
+			{
+				std::vector<size_t> merged;
+				std::vector<std::thread> workers;
+
+				for (size_t i = 0u; i + 1 < bounds.size(); i += 2)
+				{
+					merged.emplace_back(bounds[i]);
+
+					// the last part without pair moves to the next round
+					if (i + 2 < bounds.size())
+						workers.emplace_back([&, i]() { std::inplace_merge(begin + bounds[i], begin + bounds[i + 1], begin + bounds[i + 2], compare); });
+				}
+				merged.emplace_back(bounds.back());
+
+				for (auto&& worker : workers)
+					worker.join();
+
+				bounds.swap(merged);
+			}
+		}
+
+		// truncate or pad text to width
+		tstring Pad(const tstring& str, size_t width, bool right = false)
+		{
+			auto text = Text::Truncate(str, width);
+			auto padding = tstring(width - Text::Width(text), _T(' '));
+			return right ? padding + text : text + padding;
+		}
+	}
+
+	template<class Function>
+	void TableFrame::WithComparator(Function function) const
+	{
+		auto& column = _columns[_sortColumn];
+
+		if (column.type == ColumnType::ct_number)
+		{
+			auto numbers = column.numbers.data();
+			if (_ascending)
+				function([numbers](uint32_t left, uint32_t right) { return NumberLess(numbers[left], numbers[right]); });
+			else
+				function([numbers](uint32_t left, uint32_t right) { return NumberGreater(numbers[left], numbers[right]); });
+		}
+		else
+		{
+			auto text = column.text.data();
+			if (_ascending)
+				function([text](uint32_t left, uint32_t right) { return text[left] < text[right]; });
+			else
+				function([text](uint32_t left, uint32_t right) { return text[right] < text[left]; });
+		}
+	}
+
+	size_t TableFrame::Row::GetIndex() const
+	{
+		return _row;
+	}
+
+	double TableFrame::Row::GetNumber(size_t column) const
+	{
+		assert(_table._columns[column].type == ColumnType::ct_number);
+		return _table._columns[column].numbers[_row];
+	}
+
+	const tstring& TableFrame::Row::GetText(size_t column) const
+	{
+		assert(_table._columns[column].type == ColumnType::ct_text);
+		return _table._columns[column].text[_row];
+	}
+
+	TableFrame::TableFrame(const tstring& caption) :MenuFrame(caption)
+	{
+	}
+
+	size_t TableFrame::AddColumn(const tstring& name, short width, ColumnType type, int precision)
+	{
+		size_t index;
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			Column column{ name, width, type, precision, {}, {} };
+
+			// existing rows get empty cells
+			if (type == ColumnType::ct_number)
+				column.numbers.assign(_rows, std::numeric_limits<double>::quiet_NaN());
+			else
+				column.text.assign(_rows, tstring());
+
+			_columns.emplace_back(std::move(column));
+			index = _columns.size() - 1;
+		}
+		Update();
+		return index;
+	}
+
+	size_t TableFrame::GetColumnCount() const
+	{
+		std::lock_guard<std::mutex> lk(_tableMutex);
+		return _columns.size();
+	}
+
+	void TableFrame::Reserve(size_t rows)
+	{
+		std::lock_guard<std::mutex> lk(_tableMutex);
+
+		for (auto&& column : _columns)
+		{
+			if (column.type == ColumnType::ct_number)
+				column.numbers.reserve(rows);
+			else
+				column.text.reserve(rows);
+		}
+		_order.reserve(rows);
+	}
+
+	size_t TableFrame::AddRow(const std::vector<tstring>& cells)
+	{
+		size_t row;
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			row = Append(cells);
+
+			if (!_filter || _filter(Row(*this, row)))
+			{
+				if (_sortColumn == tstring::npos)
+				{
+					_order.emplace_back(static_cast<uint32_t>(row));
+				}
+				else
+				{
+					WithComparator([this, row](auto compare)
+					{
+						auto position = std::upper_bound(_order.begin(), _order.end(), static_cast<uint32_t>(row), compare);
+						_order.insert(position, static_cast<uint32_t>(row));
+					});
+				}
+			}
+		}
+		Update();
+		return row;
+	}
+
+	void TableFrame::AddRows(const std::vector<std::vector<tstring>>& rows)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			auto sorted = _order.size();
+
+			for (auto&& cells : rows)
+			{
+				auto row = Append(cells);
+				if (!_filter || _filter(Row(*this, row)))
+					_order.emplace_back(static_cast<uint32_t>(row));
+			}
+
+			// sort only new rows and merge them with sorted ones
+			if (_sortColumn != tstring::npos)
+			{
+				WithComparator([this, sorted](auto compare)
+				{
+					auto middle = _order.begin() + sorted;
+					std::stable_sort(middle, _order.end(), compare);
+					std::inplace_merge(_order.begin(), middle, _order.end(), compare);
+				});
+			}
+		}
+		Update();
+	}
+
+	void TableFrame::SetText(size_t row, size_t column, const tstring& value)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			assert(row < _rows && _columns[column].type == ColumnType::ct_text);
+			_columns[column].text[row] = value;
+			Place(row, column);
+		}
+		Update();
+	}
+
+	void TableFrame::SetNumber(size_t row, size_t column, double value)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			assert(row < _rows && _columns[column].type == ColumnType::ct_number);
+			_columns[column].numbers[row] = value;
+			Place(row, column);
+		}
+		Update();
+	}
+
+	size_t TableFrame::GetRowCount() const
+	{
+		std::lock_guard<std::mutex> lk(_tableMutex);
+		return _rows;
+	}
+
+	size_t TableFrame::GetVisibleRowCount() const
+	{
+		std::lock_guard<std::mutex> lk(_tableMutex);
+		return _order.size();
+	}
+
+	void TableFrame::ClearRows()
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			for (auto&& column : _columns)
+			{
+				column.text.clear();
+				column.numbers.clear();
+			}
+			_rows = 0u;
+			_order.clear();
+			_first = 0u;
+		}
+		Update();
+	}
+
+	void TableFrame::Sort(size_t column, bool ascending)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			assert(column < _columns.size());
+
+			_sortColumn = column;
+			_ascending = ascending;
+			_first = 0u;
+
+			SortOrder();
+		}
+		Update();
+	}
+
+	size_t TableFrame::GetSortColumn() const
+	{
+		std::lock_guard<std::mutex> lk(_tableMutex);
+		return _sortColumn;
+	}
+
+	void TableFrame::SetFilter(std::function<bool(const Row&)> predicate)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			_filter = predicate;
+			_first = 0u;
+
+			Reorder();
+		}
+		Update();
+	}
+
+	void TableFrame::PageUp()
+	{
+		Scroll(-static_cast<long long>(GetPageRows()));
+	}
+
+	void TableFrame::PageDown()
+	{
+		Scroll(static_cast<long long>(GetPageRows()));
+	}
+
+	void TableFrame::ScrollHome()
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+			_first = 0u;
+		}
+		Update();
+	}
+
+	void TableFrame::ScrollEnd()
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+			_first = _order.size() > _pageRows ? _order.size() - _pageRows : 0u;
+		}
+		Update();
+	}
+
+	bool TableFrame::HandleKey(unsigned short code, bool extended)
+	{
+		size_t column;
+		size_t count;
+		bool ascending;
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			if (_columns.empty())
+				return false;
+
+			column = _sortColumn;
+			count = _columns.size();
+			ascending = _ascending;
+		}
+
+		// ctrl + left
+		if (extended && code == 115)
+			column = column == tstring::npos || column == 0 ? count - 1 : column - 1;
+		// ctrl + right
+		else if (extended && code == 116)
+			column = column == tstring::npos ? 0u : (column + 1) % count;
+		// ctrl + s
+		else if (!extended && code == 19 && column != tstring::npos)
+			ascending = !ascending;
+		else
+			return false;
+
+		Sort(column, ascending);
+		return true;
+	}
+
+	void TableFrame::Draw()
+	{
+		if (_hOutput == nullptr)
+			return;
+
+		COORD origin;
+		short width;
+		int lines;
+		if (!GetTextArea(origin, width, lines))
+			return;
+
+		std::lock_guard<std::mutex> lk(_tableMutex);
+
+		// header
+		tstring header;
+		for (size_t i = 0u; i < _columns.size(); ++i)
+		{
+			auto name = _columns[i].name;
+			if (i == _sortColumn)
+				name += _ascending ? AscendingSymbol : DescendingSymbol;
+
+			header += Pad(name, _columns[i].width) + _T(' ');
+		}
+
+		Write(origin, Pad(header, width));
+
+		_pageRows = lines > 1 ? size_t(lines - 1) : 1u;
+
+		// rows may be removed by filter after scrolling
+		if (_first + _pageRows > _order.size())
+			_first = _order.size() > _pageRows ? _order.size() - _pageRows : 0u;
+
+		for (size_t i = 0u; i + 1 < size_t(lines); ++i)
+		{
+			tstring line;
+			if (_first + i < _order.size())
+			{
+				auto row = _order[_first + i];
+				for (auto&& column : _columns)
+					line += FormatCell(column, row) + _T(' ');
+			}
+
+			COORD coord = { origin.X, static_cast<SHORT>(origin.Y + 1 + i) };
+			Write(coord, Pad(line, width));
+		}
+		_outstream.flush();
+	}
+
+	size_t TableFrame::Append(const std::vector<tstring>& cells)
+	{
+		for (size_t i = 0u; i < _columns.size(); ++i)
+		{
+			auto& column = _columns[i];
+			auto cell = i < cells.size() ? cells[i] : tstring();
+
+			if (column.type == ColumnType::ct_number)
+			{
+				TCHAR* end = nullptr;
+				auto value = _tcstod(cell.c_str(), &end);
+				column.numbers.emplace_back(end != cell.c_str() ? value : std::numeric_limits<double>::quiet_NaN());
+			}
+			else
+			{
+				column.text.emplace_back(std::move(cell));
+			}
+		}
+		return _rows++;
+	}
+
+	void TableFrame::Reorder()
+	{
+		_order.clear();
+
+		for (size_t row = 0u; row < _rows; ++row)
+		{
+			if (!_filter || _filter(Row(*this, row)))
+				_order.emplace_back(static_cast<uint32_t>(row));
+		}
+		SortOrder();
+	}
+
+	void TableFrame::Place(size_t row, size_t column)
+	{
+		auto index = static_cast<uint32_t>(row);
+		auto position = std::find(_order.begin(), _order.end(), index);
+		auto visible = !_filter || _filter(Row(*this, row));
+
+		// order is not changed by other columns
+		if (visible && position != _order.end() && column != _sortColumn)
+			return;
+
+		if (position != _order.end())
+			_order.erase(position);
+
+		if (!visible)
+			return;
+
+		// the rest of order is sorted, so the row is inserted as by add
+		if (_sortColumn == tstring::npos)
+		{
+			_order.insert(std::lower_bound(_order.begin(), _order.end(), index), index);
+		}
+		else
+		{
+			WithComparator([this, index](auto compare)
+			{
+				_order.insert(std::upper_bound(_order.begin(), _order.end(), index, compare), index);
+			});
+		}
+	}
+
+	void TableFrame::SortOrder()
+	{
+		if (_sortColumn == tstring::npos)
+			return;
+
+		WithComparator([this](auto compare) { ParallelSort(_order, compare); });
+	}
+
+	tstring TableFrame::FormatCell(const Column& column, size_t row) const
+	{
+		if (column.type == ColumnType::ct_text)
+			return Pad(column.text[row], column.width);
+
+		auto value = column.numbers[row];
+		if (std::isnan(value))
+			return Pad(tstring(), column.width);
+
+		std::basic_ostringstream<TCHAR> stream;
+		stream << std::fixed << std::setprecision(column.precision) << value;
+		return Pad(stream.str(), column.width, true);
+	}
+
+	size_t TableFrame::GetPageRows() const
+	{
+		std::lock_guard<std::mutex> lk(_tableMutex);
+		return _pageRows;
+	}
+
+	void TableFrame::Scroll(long long rows)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_tableMutex);
+
+			auto last = _order.size() > _pageRows ? _order.size() - _pageRows : 0u;
+
+			if (rows < 0)
+				_first = size_t(-rows) < _first ? _first - size_t(-rows) : 0u;
+			else
+				_first = size_t(rows) < last - std::min(_first, last) ? _first + size_t(rows) : last;
+		}
+		Update();
+	}
+}
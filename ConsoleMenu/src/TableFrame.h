@@ -0,0 +1,167 @@
+#pragma once
+
+#include "Menu.h"
+
+namespace Menu
+{
+	// Frame showing rows of columns with sorting and filtering.
+	// Cells are stored by columns, sorting and filtering reorder only indexes of rows,
+	// drawing and scrolling touch visible rows only.
+	// Keys: ctrl + left/right - sort by previous/next column, ctrl + s - reverse order.
+	class TableFrame : public MenuFrame
+	{
+	public:
+
+		enum class ColumnType
+		{
+			// cells are compared as strings
+			ct_text,
+			// cells are parsed and compared as numbers
+			ct_number,
+		};
+
+		// read access to cells of one row, passed to filter
+		class Row
+		{
+			const TableFrame& _table;
+			size_t _row;
+
+		public:
+
+			// c-tor
+			Row(const TableFrame& table, size_t row) :_table(table), _row(row) {};
+
+			// return index of row
+			size_t GetIndex() const;
+
+			// return cell of number column
+			double GetNumber(size_t column) const;
+
+			// return cell of text column
+			const tstring& GetText(size_t column) const;
+		};
+
+		// c-tor
+		explicit TableFrame(const tstring& caption);
+
+		// add column, return its index
+		// precision - digits after point of number column
+		size_t AddColumn(const tstring& name, short width, ColumnType type = ColumnType::ct_text, int precision = 0);
+
+		// return count of columns
+		size_t GetColumnCount() const;
+
+		// reserve memory for count of rows
+		void Reserve(size_t rows);
+
+		// add row, cells of number columns are parsed, missing cells are empty
+		// return index of row
+		size_t AddRow(const std::vector<tstring>& cells);
+
+		// add several rows with single repaint
+		void AddRows(const std::vector<std::vector<tstring>>& rows);
+
+		// change cell, row moves to its place in sorted column and is shown or hidden by filter
+		void SetText(size_t row, size_t column, const tstring& value);
+		void SetNumber(size_t row, size_t column, double value);
+
+		// return count of rows
+		size_t GetRowCount() const;
+
+		// return count of rows passed filter
+		size_t GetVisibleRowCount() const;
+
+		// remove all rows, columns are kept
+		void ClearRows();
+
+		// sort rows by column, equal cells keep previous order
+		void Sort(size_t column, bool ascending = true);
+
+		// return sorted column, npos if rows are not sorted
+		size_t GetSortColumn() const;
+
+		// show only rows for which predicate returns true, nullptr shows all rows
+		// predicate must not call methods of table
+		void SetFilter(std::function<bool(const Row&)> predicate);
+
+		// scroll rows
+		void PageUp() override;
+		void PageDown() override;
+		void ScrollHome() override;
+		void ScrollEnd() override;
+
+		// sorting keys
+		bool HandleKey(unsigned short code, bool extended) override;
+
+	protected:
+
+		// draw header and visible rows
+		void Draw() override;
+
+	private:
+
+		struct Column
+		{
+			tstring name;
+			short width;
+			ColumnType type;
+			int precision;
+
+			// cells of text column
+			std::vector<tstring> text;
+
+			// cells of number column
+			std::vector<double> numbers;
+		};
+
+		// columns by index
+		std::vector<Column> _columns;
+
+		// count of rows
+		size_t _rows{ 0u };
+
+		// rows passed filter in order of drawing
+		std::vector<uint32_t> _order;
+
+		// filter of rows
+		std::function<bool(const Row&)> _filter{ nullptr };
+
+		// sorting
+		size_t _sortColumn{ tstring::npos };
+		bool _ascending{ true };
+
+		// index of the first visible entry of order
+		size_t _first{ 0u };
+
+		// rows on screen, updated by draw
+		size_t _pageRows{ 1u };
+
+		// guards columns, order and view
+		mutable std::mutex _tableMutex;
+
+		// append row to columns, table must be locked
+		size_t Append(const std::vector<tstring>& cells);
+
+		// rebuild order from filter and sorting, table must be locked
+		void Reorder();
+
+		// move changed row to its place in order or out of it, table must be locked
+		void Place(size_t row, size_t column);
+
+		// sort order by current column, table must be locked
+		void SortOrder();
+
+		// call function with comparator of rows by current column, table must be locked
+		template<class Function>
+		void WithComparator(Function function) const;
+
+		// return text of cell padded or truncated to column width
+		tstring FormatCell(const Column& column, size_t row) const;
+
+		// return count of rows on screen
+		size_t GetPageRows() const;
+
+		// move view by count of rows, negative - up
+		void Scroll(long long rows);
+	};
+}
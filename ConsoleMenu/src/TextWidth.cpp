@@ -0,0 +1,100 @@
+#include "TextWidth.h"
+
+namespace Menu {
+
+	namespace Text {
+
+		namespace
+		{
+			// read code point at pos and move pos after it
+			uint32_t Decode(const tstring& str, size_t& pos, size_t end)
+			{
+#ifdef UNICODE
+				uint32_t code = static_cast<uint32_t>(str[pos++]);
+
+				// utf-16 surrogate pair
+				if (code >= 0xD800 && code < 0xDC00 && pos < end)
+				{
+					uint32_t low = static_cast<uint32_t>(str[pos]);
+					if (low >= 0xDC00 && low < 0xE000)
+					{
+						++pos;
+						code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					}
+				}
+				return code;
+#else
+				// single byte code page, every character takes one column
+				return static_cast<unsigned char>(str[pos++]);
+#endif
+			}
+		}
+
+		size_t Measure(const tstring& str, size_t begin, size_t end, size_t limit, size_t* stop)
+		{
+			if (end > str.length())
+				end = str.length();
+
+			size_t width = 0u;
+			auto pos = begin;
+
+			// previous code point was zero width joiner
+			auto joined = false;
+
+			// odd regional indicator is waiting for its pair
+			auto flagOpened = false;
+
+			while (pos < end)
+			{
+				auto next = pos;
+				auto code = Decode(str, next, end);
+
+				size_t codeWidth = 0u;
+				if (joined)
+				{
+					// part of the emoji sequence
+					codeWidth = 0u;
+				}
+				else if (IsRegionalIndicator(code))
+				{
+					codeWidth = flagOpened ? 0u : 2u;
+					flagOpened = !flagOpened;
+				}
+				else
+				{
+					codeWidth = CodePointWidth(code);
+					flagOpened = false;
+				}
+				joined = code == ZeroWidthJoiner;
+
+				if (width + codeWidth > limit)
+					break;
+
+				width += codeWidth;
+				pos = next;
+			}
+
+			if (stop)
+				*stop = pos;
+
+			return width;
+		}
+
+		size_t Width(const tstring& str)
+		{
+			return Measure(str, 0u, str.length());
+		}
+
+		size_t Fit(const tstring& str, size_t begin, size_t width)
+		{
+			size_t stop = begin;
+			Measure(str, begin, str.length(), width, &stop);
+			return stop;
+		}
+
+		tstring Truncate(const tstring& str, size_t width)
+		{
+			return str.substr(0u, Fit(str, 0u, width));
+		}
+	}
+}
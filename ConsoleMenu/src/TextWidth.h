@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <TCHAR.h>
+
+#include "TextWidthTables.h"
+
+namespace Menu
+{
+	namespace Text
+	{
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+
+		// zero width joiner, glues emoji sequences into one grapheme
+		constexpr uint32_t ZeroWidthJoiner{ 0x200D };
+
+		// return true if [low, high) ranges are sorted and do not overlap
+		// depth of recursion is logarithmic, generated tables are long
+		constexpr bool IsValidTable(const Range* table, size_t low, size_t high)
+		{
+			return high - low < 2u ? low == high || table[low].first <= table[low].last
+				: IsValidTable(table, low, (low + high) / 2) && IsValidTable(table, (low + high) / 2, high)
+				&& table[(low + high) / 2 - 1].last < table[(low + high) / 2].first;
+		}
+
+		template <size_t N>
+		constexpr bool IsValidTable(const Range(&table)[N])
+		{
+			return IsValidTable(table, 0u, N);
+		}
+
+		static_assert(IsValidTable(WideRanges), "wide ranges must be sorted");
+		static_assert(IsValidTable(ZeroWidthRanges), "zero width ranges must be sorted");
+
+		// binary search of code point in [low, high) ranges
+		constexpr bool InTable(const Range* table, size_t low, size_t high, uint32_t code)
+		{
+			return low >= high ? false
+				: code < table[(low + high) / 2].first ? InTable(table, low, (low + high) / 2, code)
+				: code > table[(low + high) / 2].last ? InTable(table, (low + high) / 2 + 1, high, code)
+				: true;
+		}
+
+		template <size_t N>
+		constexpr bool InTable(const Range(&table)[N], uint32_t code)
+		{
+			return InTable(table, 0u, N, code);
+		}
+
+		// return true for regional indicators, two of them form a flag
+		constexpr bool IsRegionalIndicator(uint32_t code)
+		{
+			return code >= 0x1F1E6 && code <= 0x1F1FF;
+		}
+
+		// return count of terminal columns taken by code point
+		constexpr int CodePointWidth(uint32_t code)
+		{
+			return code < 0x20 || (code >= 0x7F && code < 0xA0) ? 0
+				: code < 0x300 ? 1
+				: InTable(ZeroWidthRanges, code) || code == ZeroWidthJoiner ? 0
+				: InTable(WideRanges, code) || IsRegionalIndicator(code) ? 2
+				: 1;
+		}
+
+		static_assert(CodePointWidth('A') == 1, "ascii is narrow");
+		static_assert(CodePointWidth(0x4E2D) == 2, "cjk ideograph is wide");
+		static_assert(CodePointWidth(0x0301) == 0, "combining mark has no width");
+		static_assert(CodePointWidth(0x0BCD) == 0, "tamil virama has no width");
+		static_assert(CodePointWidth(0x00AD) == 1, "soft hyphen is shown");
+		static_assert(CodePointWidth(0x1F600) == 2, "emoji is wide");
+
+		// return count of columns taken by [begin, end) of string
+		// stops before grapheme which makes width bigger than limit, position is written to stop
+		size_t Measure(const tstring &str, size_t begin, size_t end, size_t limit = SIZE_MAX, size_t *stop = nullptr);
+
+		// return count of columns taken by string
+		size_t Width(const tstring &str);
+
+		// return position of the first character which does not fit width from begin
+		size_t Fit(const tstring &str, size_t begin, size_t width);
+
+		// return longest prefix of string which fits width
+		tstring Truncate(const tstring &str, size_t width);
+
+		// return decimal text of integer in characters of the build
+		template <class Integer>
+		tstring Number(Integer value)
+		{
+#ifdef UNICODE
+			return std::to_wstring(value);
+#else
+			return std::to_string(value);
+#endif
+		}
+	}
+}
@@ -0,0 +1,216 @@
+#include "Trace.h"
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+namespace Menu {
+
+	namespace
+	{
+		// slot of ring buffer, sequence is index of event plus one, 0 while slot is written
+		struct Event
+		{
+			std::atomic<uint64_t> sequence;
+			std::atomic<const char*> name;
+			std::atomic<const char*> category;
+			std::atomic<int64_t> start;
+			std::atomic<int64_t> duration;
+		};
+
+		// events of one thread, written only by the owner
+		struct Buffer
+		{
+			DWORD thread;
+			std::atomic<const char*> name{ nullptr };
+			std::atomic<bool> finished{ false };
+			// count of events ever written
+			std::atomic<uint64_t> head{ 0u };
+			// events before it were cleared
+			std::atomic<uint64_t> first{ 0u };
+			// zero initialized
+			std::unique_ptr<Event[]> events{ new Event[Trace::Capacity]() };
+		};
+
+		std::mutex buffersMutex;
+		std::vector<std::shared_ptr<Buffer>> buffers;
+
+		// timestamps are relative to start of process
+		const auto epoch = std::chrono::steady_clock::now();
+
+		// buffer of thread, marks it when thread exits
+		struct Holder
+		{
+			std::shared_ptr<Buffer> buffer;
+			const char* name{ nullptr };
+
+			~Holder()
+			{
+				if (buffer)
+					buffer->finished = true;
+			}
+		};
+
+		thread_local Holder holder;
+
+		// buffer of calling thread, allocated on first recorded event
+		Buffer& ThisBuffer()
+		{
+			if (!holder.buffer)
+			{
+				holder.buffer = std::make_shared<Buffer>();
+				holder.buffer->thread = GetCurrentThreadId();
+				holder.buffer->name = holder.name;
+
+				std::lock_guard<std::mutex> lk(buffersMutex);
+				buffers.emplace_back(holder.buffer);
+			}
+			return *holder.buffer;
+		}
+
+		int64_t Nanoseconds(std::chrono::steady_clock::duration duration)
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+		}
+
+		// microseconds with fraction, unit of trace events
+		void WriteTime(std::ostream& stream, int64_t ns)
+		{
+			if (ns < 0)
+				ns = 0;
+			stream << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000;
+		}
+
+		void WriteString(std::ostream& stream, const char* text)
+		{
+			stream << '"';
+			for (auto c = text; *c; ++c)
+			{
+				if (*c == '"' || *c == '\\')
+					stream << '\\' << *c;
+				else if (static_cast<unsigned char>(*c) < 0x20)
+					stream << ' ';
+				else
+					stream << *c;
+			}
+			stream << '"';
+		}
+	}
+
+	std::atomic<bool> Trace::_enabled{ false };
+
+	void Trace::SetEnabled(bool enabled)
+	{
+		_enabled = enabled;
+	}
+
+	void Trace::Record(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+	{
+		auto& buffer = ThisBuffer();
+		auto index = buffer.head.load(std::memory_order_relaxed);
+		auto& event = buffer.events[index % Capacity];
+
+		// readers skip slot until sequence is set again
+		event.sequence.store(0u, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		event.name.store(name, std::memory_order_relaxed);
+		event.category.store(category, std::memory_order_relaxed);
+		event.start.store(Nanoseconds(start - epoch), std::memory_order_relaxed);
+		event.duration.store(Nanoseconds(end - start), std::memory_order_relaxed);
+
+		event.sequence.store(index + 1, std::memory_order_release);
+		buffer.head.store(index + 1, std::memory_order_release);
+	}
+
+	void Trace::SetThreadName(const char* name)
+	{
+		holder.name = name;
+		if (holder.buffer)
+			holder.buffer->name = name;
+	}
+
+	void Trace::Clear()
+	{
+		std::lock_guard<std::mutex> lk(buffersMutex);
+
+		buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](auto&& buffer) { return buffer->finished.load(); }), buffers.end());
+
+		for (auto&& buffer : buffers)
+			buffer->first = buffer->head.load();
+	}
+
+	void Trace::Export(std::ostream& stream)
+	{
+		std::vector<std::shared_ptr<Buffer>> copy;
+		{
+			std::lock_guard<std::mutex> lk(buffersMutex);
+			copy = buffers;
+		}
+
+		auto process = GetCurrentProcessId();
+		auto separator = "\n";
+
+		stream << "{\"traceEvents\":[";
+		for (auto&& buffer : copy)
+		{
+			if (auto name = buffer->name.load())
+			{
+				stream << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << process << ",\"tid\":" << buffer->thread << ",\"args\":{\"name\":";
+				WriteString(stream, name);
+				stream << "}}";
+				separator = ",\n";
+			}
+
+			auto head = buffer->head.load(std::memory_order_acquire);
+			auto first = std::max<uint64_t>(buffer->first.load(), head > Capacity ? head - Capacity : 0u);
+
+			for (auto index = first; index < head; ++index)
+			{
+				auto& event = buffer->events[index % Capacity];
+
+				auto sequence = event.sequence.load(std::memory_order_acquire);
+				auto name = event.name.load(std::memory_order_relaxed);
+				auto category = event.category.load(std::memory_order_relaxed);
+				auto start = event.start.load(std::memory_order_relaxed);
+				auto duration = event.duration.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+
+				// slot was overwritten while being read
+				if (sequence != index + 1 || event.sequence.load(std::memory_order_relaxed) != sequence)
+					continue;
+
+				stream << separator << "{\"name\":";
+				WriteString(stream, name);
+				stream << ",\"cat\":";
+				WriteString(stream, category);
+				stream << ",\"ph\":\"X\",\"ts\":";
+				WriteTime(stream, start);
+				stream << ",\"dur\":";
+				WriteTime(stream, duration);
+				stream << ",\"pid\":" << process << ",\"tid\":" << buffer->thread << "}";
+				separator = ",\n";
+			}
+		}
+		stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	}
+
+	bool Trace::Export(const tstring& path)
+	{
+		std::ostringstream stream;
+		Export(stream);
+		auto text = stream.str();
+
+		auto file = CreateFile(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		DWORD written = 0;
+		auto result = WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, nullptr) != 0 && written == text.size();
+		CloseHandle(file);
+		return result;
+	}
+}
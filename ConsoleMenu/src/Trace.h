@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <windows.h>
+#include <TCHAR.h>
+
+namespace Menu
+{
+	// Recorder of timed spans exported as chrome trace events.
+	// Every thread writes to its own ring buffer without locks, the oldest events are overwritten.
+	// Export reads buffers while threads keep recording, events being overwritten are skipped.
+	// Names and categories are not copied, they have to be string literals.
+	class Trace
+	{
+	public:
+
+		using tstring = std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR>>;
+
+		// count of events kept per thread
+		static const size_t Capacity{ 16384u };
+
+		// switch recording, spans started while disabled are not recorded
+		static void SetEnabled(bool enabled);
+		static bool IsEnabled() { return _enabled.load(std::memory_order_relaxed); }
+
+		// record span of calling thread
+		static void Record(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+		// name of calling thread shown by viewer, does not allocate buffer
+		static void SetThreadName(const char* name);
+
+		// drop recorded events and buffers of finished threads
+		static void Clear();
+
+		// write events as trace event json
+		static void Export(std::ostream& stream);
+
+		// write events to file, return false on failure
+		static bool Export(const tstring& path);
+
+	private:
+
+		static std::atomic<bool> _enabled;
+	};
+
+	// Span recorded from construction to destruction, costs a load of flag when tracing is disabled.
+	class TraceSpan
+	{
+	public:
+
+		// c-tor, starts span if tracing is enabled
+		TraceSpan(const char* name, const char* category) :_name(name), _category(category)
+		{
+			if (Trace::IsEnabled())
+			{
+				_start = std::chrono::steady_clock::now();
+				_started = true;
+			}
+		}
+
+		// d-tor, records span
+		~TraceSpan()
+		{
+			if (_started)
+				Trace::Record(_name, _category, _start, std::chrono::steady_clock::now());
+		}
+
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator=(const TraceSpan&) = delete;
+
+	private:
+
+		const char* _name;
+		const char* _category;
+		std::chrono::steady_clock::time_point _start;
+		bool _started{ false };
+	};
+}
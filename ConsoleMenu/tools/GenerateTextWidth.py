@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Generate src/TextWidthTables.h with wide and zero width code points.
+
+usage: GenerateTextWidth.py [ucd-directory]
+
+ucd-directory holds EastAsianWidth.txt and UnicodeData.txt of the wanted
+Unicode version, without it the data of python's unicodedata module is used.
+"""
+
+import os
+import sys
+
+# combining marks, enclosing marks and format characters take no columns
+ZERO_WIDTH_CATEGORIES = {'Mn', 'Me', 'Cf'}
+
+# soft hyphen is shown by terminals
+ZERO_WIDTH_EXCLUDED = {0x00AD}
+
+# conjoining hangul vowels and finals, emoji modifiers and the block of tags and variation selectors
+ZERO_WIDTH_EXTRA = [(0x1160, 0x11FF), (0xD7B0, 0xD7FF), (0x1F3FB, 0x1F3FF), (0xE0000, 0xE0FFF)]
+
+# unassigned code points of these blocks default to wide
+WIDE_DEFAULT = [(0x3400, 0x4DBF), (0x4E00, 0x9FFF), (0xF900, 0xFAFF), (0x20000, 0x2FFFD), (0x30000, 0x3FFFD)]
+
+OUTPUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'TextWidthTables.h')
+
+
+def parse_points(field):
+    if '..' in field:
+        first, last = field.split('..')
+        return int(first, 16), int(last, 16)
+    return int(field, 16), int(field, 16)
+
+
+def read_ucd(directory):
+    categories = {}
+    with open(os.path.join(directory, 'UnicodeData.txt'), encoding='utf-8') as data:
+        first = None
+        for line in data:
+            fields = line.split(';')
+            code, name, category = int(fields[0], 16), fields[1], fields[2]
+            # large blocks are given by their first and last code point
+            if name.endswith(', First>'):
+                first = code
+                continue
+            for point in range(first if name.endswith(', Last>') else code, code + 1):
+                categories[point] = category
+            first = None
+
+    widths = {}
+    version = None
+    with open(os.path.join(directory, 'EastAsianWidth.txt'), encoding='utf-8') as data:
+        for line in data:
+            if version is None and line.startswith('# EastAsianWidth-'):
+                version = line[len('# EastAsianWidth-'):].split('.txt')[0]
+            line = line.split('#')[0].strip()
+            if not line:
+                continue
+            points, width = [field.strip() for field in line.split(';')]
+            first, last = parse_points(points)
+            for point in range(first, last + 1):
+                widths[point] = width
+
+    return version or 'unknown', categories.get, lambda point: widths.get(point, 'N')
+
+
+def read_python():
+    import unicodedata
+    return unicodedata.unidata_version, lambda point: unicodedata.category(chr(point)), lambda point: unicodedata.east_asian_width(chr(point))
+
+
+def to_ranges(points):
+    ranges = []
+    for point in sorted(points):
+        if ranges and ranges[-1][1] + 1 == point:
+            ranges[-1][1] = point
+        else:
+            ranges.append([point, point])
+    return ranges
+
+
+def format_table(name, comment, ranges):
+    lines = ['\t\t// ' + line for line in comment]
+    lines.append('\t\tconstexpr Range %s[] =' % name)
+    lines.append('\t\t{')
+    for row in range(0, len(ranges), 5):
+        items = ['{ 0x%04X, 0x%04X },' % tuple(item) for item in ranges[row:row + 5]]
+        lines.append('\t\t\t' + ' '.join(items))
+    lines.append('\t\t};')
+    return lines
+
+
+def main():
+    version, category, east_asian_width = read_ucd(sys.argv[1]) if len(sys.argv) > 1 else read_python()
+
+    zero = set()
+    wide = set()
+    for point in range(0x300, 0x110000):
+        point_category = category(point)
+        # unassigned code points are narrow, except blocks of WIDE_DEFAULT
+        if point_category in (None, 'Cn'):
+            continue
+        if point_category in ZERO_WIDTH_CATEGORIES and point not in ZERO_WIDTH_EXCLUDED:
+            zero.add(point)
+        elif east_asian_width(point) in ('W', 'F'):
+            wide.add(point)
+
+    for first, last in ZERO_WIDTH_EXTRA:
+        zero.update(range(first, last + 1))
+    for first, last in WIDE_DEFAULT:
+        wide.update(point for point in range(first, last + 1) if point not in zero)
+    wide -= zero
+
+    lines = [
+        '#pragma once',
+        '',
+        '// generated by tools/GenerateTextWidth.py from Unicode %s, do not edit' % version,
+        '',
+        '#include <cstdint>',
+        '',
+        'namespace Menu',
+        '{',
+        '\tnamespace Text',
+        '\t{',
+        '\t\t// inclusive range of code points',
+        '\t\tstruct Range',
+        '\t\t{',
+        '\t\t\tuint32_t first;',
+        '\t\t\tuint32_t last;',
+        '\t\t};',
+        '',
+    ]
+    lines += format_table('WideRanges', ['East Asian Wide and Fullwidth code points, including emoji presentation'], to_ranges(wide))
+    lines.append('')
+    lines += format_table('ZeroWidthRanges', ['combining marks, format characters, joiners, variation selectors and emoji modifiers',
+                                              'they extend the previous grapheme and take no columns'], to_ranges(zero))
+    lines += ['\t}', '}', '']
+
+    with open(OUTPUT, 'w', newline='\n') as output:
+        output.write('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    main()